@@ -0,0 +1,589 @@
+// Copyright (c) 2011, James Hughes
+// All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Measures the DLConvert kernels on synthetic frames, so machines can be
+// compared without a Decklink card, openframeworks or Windows. Each path runs
+// the kernels in the same order DLCapture does, with the rows of a frame split
+// into bands that the worker threads take as they come free, the same way,
+// and a frame is done when the last band is.
+//
+//   make
+//   ./convertBenchmark [-i scalar|ssse3|avx2] [-t max threads] [-s seconds]
+//                      [-r 720p,1080p,2k,uhd] [-k name filter]
+//
+// Only DLCapture's OpenCV resize isn't covered; the YUV box downscale that
+// replaces it for YUV input is.
+
+#include "DLConvert.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace DLConvert;
+
+enum Input {
+    INPUT_UYVY,     // bmdFormat8BitYUV
+    INPUT_V210,     // bmdFormat10BitYUV
+    INPUT_ARGB,     // bmdFormat8BitARGB
+    INPUT_BGRA,     // bmdFormat8BitBGRA
+    INPUT_R210      // bmdFormat10BitRGB
+};
+
+// same padding as the card
+static long
+InputRowBytes(Input input, long width)
+{
+    switch(input) {
+        case INPUT_V210: return ((width + 47) / 48) * 128;
+        case INPUT_ARGB:
+        case INPUT_BGRA: return width * 4;
+        case INPUT_R210: return ((width + 63) / 64) * 256;
+        default:         return ((width + 1) / 2) * 4;
+    }
+}
+
+// everything the paths need, picked once for the instruction set like
+// DLCapture::ApplySettings does
+struct Kernels {
+    Isa             isa;
+    Colorimetry     colorimetry;
+    RowFn           uyvyToRgb;
+    RowFn           uyvyToRgba;
+    RowFn           uyvyToBgra;
+    RowFn           uyvyToRgbLinear;
+    RowFn           uyvyToGray;
+    RowFn           uyvyToUyvy16;
+    RowFn           uyvy16ToRgb16;
+    RowFn           v210ToUyvy;
+    RowFn           v210ToUyvy16;
+    RowFn           v210ToGray;
+    RowFn           v210ToGray16;
+    RowFn           argbToBgra;
+    RowFn           r210ToRgb;
+    RowFn           r210ToRgb16;
+    RowPairFn       uyvyToNv12;
+    RowPairFn       uyvyToI420;
+    FloatRowFn      uyvyToFloat;
+    FloatRowFn      uyvyToHalfPlanar;
+    AccumulateFn    accumulateRow;
+    BoxDownscaleFn  boxDownscale;
+    Lut3DFn         rgbLut3D;
+    Lut3DFn         bgraLut3D;
+    ToneMapFn       toneMap;
+    Normalization   normalization;
+    Lut3D           lut3D;
+    LookupTables   *tables;
+    ToneMapTables  *toneTables;
+};
+
+static Kernels kernels;
+
+// A frame's worth of input, and an output buffer big enough for any path
+struct Frame {
+    long            width;
+    long            height;
+    unsigned char  *src;
+    long            srcRowBytes;
+    unsigned char  *dst;
+};
+
+// per worker rows, like the vectors in DLCapture::ConvertChunk
+struct Scratch {
+    std::vector<unsigned char>  row0;
+    std::vector<unsigned char>  row1;
+    std::vector<unsigned short> sums;
+    DLConvert::BoxColumns       columns;
+};
+
+struct Case {
+    const char     *name;
+    Input           input;
+    double          outBytes;       // written per input pixel
+    int             scale;          // 2 or 4 for the half and quarter size downscales
+    void          (*run)(const Frame &frame, Scratch &scratch, long firstRow, long numRows);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Paths
+////////////////////////////////////////////////////////////////////////////////
+
+static inline const unsigned char*
+SrcRow(const Frame &f, long row)
+{
+    return f.src + row * f.srcRowBytes;
+}
+
+// one kernel straight from the input row to the output row
+template<RowFn Kernels::*Fn, int OutBytes>
+static void
+RowCase(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++)
+        (kernels.*Fn)(SrcRow(f, row), f.dst + row * f.width * OutBytes, f.width);
+}
+
+// v210 unpacked into scratch, then a second kernel
+template<RowFn Kernels::*Unpack, RowFn Kernels::*Fn, int OutBytes>
+static void
+UnpackCase(const Frame &f, Scratch &s, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        (kernels.*Unpack)(SrcRow(f, row), &s.row0[0], f.width);
+        (kernels.*Fn)(&s.row0[0], f.dst + row * f.width * OutBytes, f.width);
+    }
+}
+
+static void
+LutRgb(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++)
+        UyvyToRgb_Lut(*kernels.tables, SrcRow(f, row), f.dst + row * f.width * 3, f.width);
+}
+
+static void
+GradedRgb(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        unsigned char *dst = f.dst + row * f.width * 3;
+        kernels.uyvyToRgb(SrcRow(f, row), dst, f.width);
+        kernels.rgbLut3D(kernels.lut3D, dst, f.width);
+    }
+}
+
+static void
+GradedBgra(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        unsigned char *dst = f.dst + row * f.width * 4;
+        memcpy(dst, SrcRow(f, row), f.width * 4);
+        kernels.bgraLut3D(kernels.lut3D, dst, f.width);
+    }
+}
+
+static void
+ToneMapped(const Frame &f, Scratch &s, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        kernels.v210ToUyvy16(SrcRow(f, row), &s.row0[0], f.width);
+        kernels.toneMap(*kernels.toneTables, &s.row0[0], f.dst + row * f.width * 3, f.width);
+    }
+}
+
+// runs always start on an even row, so the pairs never straddle two workers
+template<RowPairFn Kernels::*Fn, bool Planar>
+static void
+Yuv420(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    unsigned char *luma    = f.dst;
+    unsigned char *chroma0 = luma + f.width * f.height;
+    long           crow    = (f.width + 1) / 2;
+    unsigned char *chroma1 = chroma0 + crow * ((f.height + 1) / 2);
+
+    for(long row=firstRow; row<firstRow+numRows; row+=2) {
+        long next = (row + 1 < f.height) ? row + 1 : row;
+        (kernels.*Fn)(SrcRow(f, row), SrcRow(f, next),
+                      luma + row * f.width, luma + next * f.width,
+                      chroma0 + (row / 2) * (Planar ? crow : f.width),
+                      Planar ? chroma1 + (row / 2) * crow : NULL,
+                      f.width);
+    }
+}
+
+static void
+FloatRgb(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        unsigned char *dst[3] = { f.dst + row * f.width * 12, NULL, NULL };
+        kernels.uyvyToFloat(SrcRow(f, row), dst, kernels.normalization, f.width);
+    }
+}
+
+static void
+HalfPlanar(const Frame &f, Scratch &, long firstRow, long numRows)
+{
+    long plane = f.width * 2 * f.height;
+
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        unsigned char *base   = f.dst + row * f.width * 2;
+        unsigned char *dst[3] = { base, base + plane, base + plane * 2 };
+        kernels.uyvyToHalfPlanar(SrcRow(f, row), dst, kernels.normalization, f.width);
+    }
+}
+
+// setSize(width / Scale, height / Scale) on YUV input: the rows are output
+// rows, each one the sum of Scale input rows box filtered and then converted
+template<Input In, int Scale>
+static void
+DownscaledRgb(const Frame &f, Scratch &s, long firstRow, long numRows)
+{
+    long src_bytes = ((f.width + 1) / 2) * 4;
+    long dst_width = f.width / Scale;
+
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        memset(&s.sums[0], 0, src_bytes * sizeof(unsigned short));
+        for(long y=row*Scale; y<row*Scale+Scale; y++) {
+            const unsigned char *line = SrcRow(f, y);
+            if(In == INPUT_V210) {
+                kernels.v210ToUyvy(line, &s.row1[0], f.width);
+                line = &s.row1[0];
+            }
+            kernels.accumulateRow(line, &s.sums[0], src_bytes);
+        }
+        kernels.boxDownscale(s.columns, &s.sums[0], Scale, &s.row0[0]);
+        kernels.uyvyToRgb(&s.row0[0], f.dst + row * dst_width * 3, dst_width);
+    }
+}
+
+static const Case cases[] = {
+    { "uyvy-rgb",           INPUT_UYVY, 3,    1, &RowCase<&Kernels::uyvyToRgb, 3> },
+    { "uyvy-rgba",          INPUT_UYVY, 4,    1, &RowCase<&Kernels::uyvyToRgba, 4> },
+    { "uyvy-bgra",          INPUT_UYVY, 4,    1, &RowCase<&Kernels::uyvyToBgra, 4> },
+    { "uyvy-rgb-linear",    INPUT_UYVY, 3,    1, &RowCase<&Kernels::uyvyToRgbLinear, 3> },
+    { "uyvy-rgb-lut",       INPUT_UYVY, 3,    1, &LutRgb },
+    { "uyvy-rgb-lut3d",     INPUT_UYVY, 3,    1, &GradedRgb },
+    { "uyvy-gray",          INPUT_UYVY, 1,    1, &RowCase<&Kernels::uyvyToGray, 1> },
+    { "uyvy-yuv16",         INPUT_UYVY, 4,    1, &RowCase<&Kernels::uyvyToUyvy16, 4> },
+    { "uyvy-rgb16",         INPUT_UYVY, 6,    1, &UnpackCase<&Kernels::uyvyToUyvy16, &Kernels::uyvy16ToRgb16, 6> },
+    { "uyvy-nv12",          INPUT_UYVY, 1.5,  1, &Yuv420<&Kernels::uyvyToNv12, false> },
+    { "uyvy-i420",          INPUT_UYVY, 1.5,  1, &Yuv420<&Kernels::uyvyToI420, true> },
+    { "uyvy-rgb32f",        INPUT_UYVY, 12,   1, &FloatRgb },
+    { "uyvy-rgb16f-planar", INPUT_UYVY, 6,    1, &HalfPlanar },
+    { "uyvy-rgb-half-size", INPUT_UYVY, 0.75, 2, &DownscaledRgb<INPUT_UYVY, 2> },
+    { "uyvy-rgb-quarter",   INPUT_UYVY, 0.1875, 4, &DownscaledRgb<INPUT_UYVY, 4> },
+    { "v210-rgb",           INPUT_V210, 3,    1, &UnpackCase<&Kernels::v210ToUyvy, &Kernels::uyvyToRgb, 3> },
+    { "v210-gray",          INPUT_V210, 1,    1, &RowCase<&Kernels::v210ToGray, 1> },
+    { "v210-yuv16",         INPUT_V210, 4,    1, &RowCase<&Kernels::v210ToUyvy16, 4> },
+    { "v210-gray16",        INPUT_V210, 2,    1, &RowCase<&Kernels::v210ToGray16, 2> },
+    { "v210-rgb16",         INPUT_V210, 6,    1, &UnpackCase<&Kernels::v210ToUyvy16, &Kernels::uyvy16ToRgb16, 6> },
+    { "v210-rgb-tonemap",   INPUT_V210, 3,    1, &ToneMapped },
+    { "v210-rgb-half-size", INPUT_V210, 0.75, 2, &DownscaledRgb<INPUT_V210, 2> },
+    { "argb-bgra",          INPUT_ARGB, 4,    1, &RowCase<&Kernels::argbToBgra, 4> },
+    { "bgra-lut3d",         INPUT_BGRA, 4,    1, &GradedBgra },
+    { "r210-rgb",           INPUT_R210, 3,    1, &RowCase<&Kernels::r210ToRgb, 3> },
+    { "r210-rgb16",         INPUT_R210, 6,    1, &RowCase<&Kernels::r210ToRgb16, 6> },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Setup
+////////////////////////////////////////////////////////////////////////////////
+
+static void
+SetupKernels(Isa isa)
+{
+    Colorimetry c(MATRIX_BT709, RANGE_LIMITED, RANGE_FULL);     // what DLCard picks for HD
+
+    kernels.isa              = isa;
+    kernels.colorimetry      = c;
+    kernels.uyvyToRgb        = GetUyvyToRgb(isa, c, LAYOUT_RGB);
+    kernels.uyvyToRgba       = GetUyvyToRgb(isa, c, LAYOUT_RGBA);
+    kernels.uyvyToBgra       = GetUyvyToRgb(isa, c, LAYOUT_BGRA);
+    kernels.uyvyToRgbLinear  = GetUyvyToRgb(isa, c, LAYOUT_RGB, CHROMA_LINEAR);
+    kernels.uyvyToGray       = GetUyvyToGray(isa);
+    kernels.uyvyToUyvy16     = &UyvyToUyvy16;
+    kernels.uyvy16ToRgb16    = GetUyvy16ToRgb16(isa, c);
+    kernels.v210ToUyvy       = GetV210ToUyvy(isa);
+    kernels.v210ToUyvy16     = GetV210ToUyvy16(isa);
+    kernels.v210ToGray       = GetV210ToGray(isa);
+    kernels.v210ToGray16     = GetV210ToGray16(isa);
+    kernels.argbToBgra       = GetArgbToBgra(isa);
+    kernels.r210ToRgb        = GetR210ToRgb(isa, c, LAYOUT_RGB);
+    kernels.r210ToRgb16      = GetR210ToRgb16(isa);
+    kernels.uyvyToNv12       = GetUyvyToNv12(isa);
+    kernels.uyvyToI420       = GetUyvyToI420(isa);
+    kernels.uyvyToFloat      = GetUyvyToFloat(isa, c, FLOAT_32, false);
+    kernels.uyvyToHalfPlanar = GetUyvyToFloat(isa, c, FLOAT_16, true);
+    kernels.accumulateRow    = GetAccumulateRow(isa);
+    kernels.boxDownscale     = GetUyvyBoxDownscale(isa);
+    kernels.rgbLut3D         = GetApplyLut3D(isa, LAYOUT_RGB);
+    kernels.bgraLut3D        = GetApplyLut3D(isa, LAYOUT_BGRA);
+    kernels.toneMap          = GetUyvy16ToneMap(isa, LAYOUT_RGB);
+
+    // a 33 point identity grade costs the same as any other
+    const int n = 33;
+    kernels.lut3D.size = n;
+    kernels.lut3D.entries.resize(n * n * n);
+    for(int b=0; b<n; b++)
+        for(int g=0; g<n; g++)
+            for(int r=0; r<n; r++) {
+                unsigned int rr = (r * 1020 + (n - 1) / 2) / (n - 1);
+                unsigned int gg = (g * 1020 + (n - 1) / 2) / (n - 1);
+                unsigned int bb = (b * 1020 + (n - 1) / 2) / (n - 1);
+                kernels.lut3D.entries[r + g * n + b * n * n] = rr | (gg << 10) | (bb << 20);
+            }
+
+    kernels.tables = new LookupTables;
+    CreateLookupTables(*kernels.tables, c);
+
+    kernels.toneTables = new ToneMapTables;
+    CreateToneMapTables(*kernels.toneTables, ToneMapping(), c);
+}
+
+// Noise over a gradient, so the chroma isn't constant and the lookups don't
+// all hit the same cache lines. v210 and r210 samples stay inside 10 bits.
+static void
+FillInput(Input input, unsigned char *bytes, long rowBytes, long height)
+{
+    unsigned int seed = 1;
+
+    for(long y=0; y<height; y++) {
+        unsigned char *row = bytes + y * rowBytes;
+        for(long x=0; x<rowBytes; x+=4) {
+            seed = seed * 1664525 + 1013904223;
+            unsigned int word = (seed >> 8) ^ (unsigned int)((x + y) * 0x01010101);
+            if(input == INPUT_V210)
+                word &= 0x3fffffff;
+            else if(input == INPUT_R210)
+                word &= 0xffffff3f;     // big endian, bits 30-31 are the top of byte 0
+            memcpy(row + x, &word, 4);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Threads
+////////////////////////////////////////////////////////////////////////////////
+
+static double
+Now(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// even sized bands of rows, same as DLCapture::BandRows
+static long
+BandRows(long numRows, long bytesPerRow, int threads)
+{
+    long rows = (256 * 1024) / (bytesPerRow > 0 ? bytesPerRow : 1);
+    long few  = (numRows + 4 * threads - 1) / (4 * threads);
+
+    if(rows > few)
+        rows = few;
+    rows &= ~1L;
+    return rows < 2 ? 2 : rows;
+}
+
+struct Run {
+    const Case         *test;
+    const Frame        *frame;
+    long                rows;       // rows the path splits up
+    long                bandRows;
+    int                 threads;
+    long                frames;
+    std::vector<long>   taken;      // bands handed out, per frame
+    pthread_barrier_t   start;      // workers and the timer
+    pthread_barrier_t   done;       // end of each frame, workers only
+};
+
+struct Worker {
+    Run                *run;
+    Scratch             scratch;
+    pthread_t           thread;
+};
+
+static void*
+WorkerMain(void *arg)
+{
+    Worker *worker = (Worker*)arg;
+    Run    *run    = worker->run;
+
+    pthread_barrier_wait(&run->start);
+    for(long f=0; f<run->frames; f++) {
+        // whoever is free takes the next band, like DLCapture::ConvertBands
+        for(;;) {
+            long first = __sync_fetch_and_add(&run->taken[f], 1) * run->bandRows;
+            if(first >= run->rows)
+                break;
+            long count = run->rows - first;
+            run->test->run(*run->frame, worker->scratch, first, count < run->bandRows ? count : run->bandRows);
+        }
+        pthread_barrier_wait(&run->done);
+    }
+    return NULL;
+}
+
+// seconds per frame
+static double
+TimeFrames(const Case &test, const Frame &frame, int threads, long frames)
+{
+    Run run;
+    run.test    = &test;
+    run.frame   = &frame;
+    run.rows    = frame.height / test.scale;
+    run.threads = threads;
+    run.frames  = frames;
+    run.taken.assign(frames, 0);
+    run.bandRows = BandRows(run.rows,
+                            InputRowBytes(test.input, frame.width) * test.scale + (long)(test.outBytes * frame.width * test.scale),
+                            threads);
+    pthread_barrier_init(&run.start, NULL, threads + 1);
+    pthread_barrier_init(&run.done, NULL, threads);
+
+    std::vector<Worker> workers(threads);
+    for(int t=0; t<threads; t++) {
+        Worker &w = workers[t];
+        w.run   = &run;
+        w.scratch.row0.resize(frame.width * 8 + 64);
+        w.scratch.row1.resize(frame.width * 8 + 64);
+        w.scratch.sums.resize(frame.width * 2 + 64);
+        CreateBoxColumns(w.scratch.columns, frame.width, frame.width / test.scale);
+        pthread_create(&w.thread, NULL, &WorkerMain, &w);
+    }
+
+    // start the clock before releasing the workers. On a single core they
+    // can get through the whole frame before this thread runs again, and a
+    // near zero warm up time turns into millions of timed frames.
+    double begin = Now();
+    pthread_barrier_wait(&run.start);
+    for(int t=0; t<threads; t++)
+        pthread_join(workers[t].thread, NULL);
+    double elapsed = Now() - begin;
+
+    pthread_barrier_destroy(&run.start);
+    pthread_barrier_destroy(&run.done);
+    return elapsed / frames;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+struct Resolution {
+    const char *name;
+    long        width;
+    long        height;
+};
+
+static const Resolution resolutions[] = {
+    { "720p",  1280,  720 },
+    { "1080p", 1920, 1080 },
+    { "2k",    2048, 1080 },
+    { "uhd",   3840, 2160 },
+};
+
+static void
+Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-i scalar|ssse3|avx2] [-t max threads] [-s seconds] [-r 720p,1080p,2k,uhd] [-k name filter]\n", name);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    Isa         isa         = DetectIsa();
+    int         max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double      seconds     = 0.25;
+    std::string sizes       = "720p,1080p,2k,uhd";
+    std::string filter;
+
+    for(int a=1; a<argc; a++) {
+        std::string arg = argv[a];
+        if(a + 1 >= argc)
+            Usage(argv[0]);
+
+        std::string value = argv[++a];
+        if(arg == "-i") {
+            if(value == "scalar")     isa = ISA_SCALAR;
+            else if(value == "ssse3") isa = ISA_SSSE3;
+            else if(value == "avx2")  isa = ISA_AVX2;
+            else                      Usage(argv[0]);
+            if(isa > DetectIsa()) {
+                fprintf(stderr, "%s isn't supported on this machine\n", value.c_str());
+                return 1;
+            }
+        } else if(arg == "-t") {
+            max_threads = atoi(value.c_str());
+        } else if(arg == "-s") {
+            seconds = atof(value.c_str());
+        } else if(arg == "-r") {
+            sizes = value;
+        } else if(arg == "-k") {
+            filter = value;
+        } else {
+            Usage(argv[0]);
+        }
+    }
+    if(max_threads < 1)
+        max_threads = 1;
+
+    // 1, 2, 4 ... and the maximum itself
+    std::vector<int> thread_counts;
+    for(int t=1; t<max_threads; t*=2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    SetupKernels(isa);
+    printf("%s kernels, up to %d threads. GB/s counts the bytes read and written.\n\n", IsaName(isa), max_threads);
+    printf("%-20s %-6s %7s %10s %9s %8s %8s\n", "path", "size", "threads", "ms/frame", "ns/pixel", "GB/s", "scaling");
+
+    for(size_t r=0; r<sizeof(resolutions)/sizeof(resolutions[0]); r++) {
+        const Resolution &res = resolutions[r];
+        if(("," + sizes + ",").find("," + std::string(res.name) + ",") == std::string::npos)
+            continue;
+
+        // worst case output is float RGB
+        std::vector<unsigned char> dst(res.width * res.height * 12 + 64);
+
+        for(size_t c=0; c<sizeof(cases)/sizeof(cases[0]); c++) {
+            const Case &test = cases[c];
+            if(!filter.empty() && std::string(test.name).find(filter) == std::string::npos)
+                continue;
+
+            Frame frame;
+            frame.width       = res.width;
+            frame.height      = res.height;
+            frame.srcRowBytes = InputRowBytes(test.input, res.width);
+            frame.dst         = &dst[0];
+
+            std::vector<unsigned char> src(frame.srcRowBytes * res.height + 64);
+            FillInput(test.input, &src[0], frame.srcRowBytes, res.height);
+            frame.src = &src[0];
+
+            double pixels = (double)res.width * res.height;
+            double bytes  = frame.srcRowBytes * res.height + test.outBytes * pixels;
+            double single = 0.0;
+
+            for(size_t t=0; t<thread_counts.size(); t++) {
+                int    threads = thread_counts[t];
+                double warm    = TimeFrames(test, frame, threads, 1);
+                long   frames  = (long)(seconds / (warm > 1e-6 ? warm : 1e-6));
+                double time    = TimeFrames(test, frame, threads, frames < 3 ? 3 : frames);
+
+                if(threads == 1)
+                    single = time;
+
+                printf("%-20s %-6s %7d %10.3f %9.3f %8.2f %7.2fx\n",
+                       test.name, res.name, threads,
+                       time * 1e3, time * 1e9 / pixels, bytes / time / 1e9, single / time);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -4,6 +4,7 @@
 void BlackmagicExampleApp::setup(){
 
     mZoom = false;
+    mCrop = false;
 
     // list the blackmagic devices and their capabilities
     mVidGrabber.listDevices();
@@ -45,8 +46,8 @@ void BlackmagicExampleApp::setup(){
     // bmdMode2k25         2048    1556    25          2       25000       1000
     /////////////////////////////////////////////////////////////////////////////////
 
-    // capture at 1080i, 29.97 fps - this has an internal call to setSize()
-    // which sets the size to the full resolution of the capture mode
+    // capture at 1080i, 29.97 fps - frames come out at the full resolution
+    // of the capture mode until setSize() asks for something else
 	mVidGrabber.setDisplayMode(bmdModeHD1080i5994);
 	mVidGrabber.initGrabber();
 
@@ -90,9 +91,19 @@ void BlackmagicExampleApp::keyPressed(int key){
 void BlackmagicExampleApp::keyReleased(int key){
     switch(key) {
         case 'z':
-            mZoom ? mVidGrabber.setSize(1920, 1080) : mVidGrabber.setSize(480, 270);
+            // 0x0 goes back to the size of the capture (or the crop)
+            mZoom ? mVidGrabber.setSize(0, 0) : mVidGrabber.setSize(480, 270);
             mZoom = !mZoom;
             break;
+        case 'c':
+            // convert just the middle of the frame, or go back to all of it
+            if(!mCrop) {
+                mVidGrabber.setCrop(480, 270, 960, 540);
+            } else {
+                mVidGrabber.setCrop(0, 0, 0, 0);
+            }
+            mCrop = !mCrop;
+            break;
     }
 }
 
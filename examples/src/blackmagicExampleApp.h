@@ -27,6 +27,7 @@ public:
     ofImage         mGrayscaleImage;
 
     bool            mZoom;
+    bool            mCrop;
 
 };
 
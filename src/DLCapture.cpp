@@ -20,21 +20,51 @@
 // SOFTWARE.
 
 #include "DLCapture.h"
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <vector>
 #include "cv.h"
+#include "boost/function.hpp"
 #include "boost/thread.hpp"
+#include "ofUtils.h"
 
 using namespace boost;
 
 DLCapture::DLCapture() : mRefCount(1),
                          mFrameCount(0),
-                         mDimensionsInitialized(false),
-                         mWidth(-1),
-                         mHeight(-1),
-                         mFramerateTimestamps(60)
+                         mCaptureWidth(0),
+                         mCaptureHeight(0),
+                         mWidth(0),
+                         mHeight(0),
+                         mFrameWidth(0),
+                         mFrameHeight(0),
+                         mFramerateTimestamps(60),
+                         mAffinity(0),
+                         mNumaNode(-1),
+                         mPipelineDepth(2),
+                         mPipelinePeak(0),
+                         mDroppedFrames(0),
+                         mFramesInFlight(0),
+                         mPipelineStop(false),
+                         mNextSequence(0),
+                         mReorderStall(-1),
+                         mLateFrames(0)
 {
-    // generate the YUV lookup tables and store them in memory
-	CreateLookupTables();
+    // use the fastest YUV -> RGB kernels this CPU supports. The lookup tables
+    // aren't generated unless someone asks for them with setConversionMethod
+    mIsa = DLConvert::DetectIsa();
+    ofLog(OF_LOG_VERBOSE, "DLCapture - using %s YUV to RGB conversion", DLConvert::IsaName(mIsa));
+
+    Settings settings;
+    settings.method     = DLConvert::METHOD_FIXED_POINT;
+    settings.colorspace = DLFrame::DL_RGB;
+    settings.chroma     = DLConvert::CHROMA_NEAREST;
+    settings.cropX      = 0;
+    settings.cropY      = 0;
+    settings.cropWidth  = 0;
+    settings.cropHeight = 0;
+    ApplySettings(settings);
 
 	// figure out how much concurrency we have on this box
 	// note: it's possible for hardware_concurrency to return 0.
@@ -43,10 +73,26 @@ DLCapture::DLCapture() : mRefCount(1),
 	
 	// size our threadpool appropriately
     setThreadpoolSize(pool_size);
+
+    // start the conversion stage. With two frames in flight the workers can
+    // start on the next frame while the last chunks of this one finish
+    setFramesInFlight(2);
 }
 
 DLCapture::~DLCapture()
 {
+    {
+        mutex::scoped_lock l(mPipelineMutex);
+        mPipelineStop = true;
+    }
+    mPipelineReady.notify_all();
+    mPipelineThreads.join_all();
+
+    // anything the stage didn't get to still holds a card buffer
+    while(!mPending.empty()) {
+        mPending.front().frame->Release();
+        mPending.pop_front();
+    }
 }
 
 
@@ -101,67 +147,181 @@ DLCapture::VideoInputFormatChanged(BMDVideoInputFormatChangedEvents notification
                                    IDeckLinkDisplayMode* newDisplayMode,
                                    BMDDetectedVideoInputFormatFlags detectedSignalFlags)
 {
-    // NOTE: we can't set dimensions and stuff here because:
-    // a) row bytes and pixel format aren't available
-    // b) this doesn't get called on startup
-
-    mDimensionsInitialized = false;
+    // NOTE: nothing to do here. Every frame's size and format are read off
+    // the frame itself, which also covers startup (this isn't called then)
     return S_OK;
 }
 
+// The size of the frames coming out, which isn't always the one setSize()
+// asked for: frames already in flight keep the size they started with, and
+// some colorspaces can't be scaled. Until the first frame it's the size
+// asked for, or the crop's or the capture's when nothing was.
 unsigned int
 DLCapture::getWidth(void)
 {
-    return mWidth;
+    SettingsPtr settings = GetSettings();
+
+    mutex::scoped_lock l(mDimensionsMutex);
+    if(mFrameWidth > 0)
+        return (unsigned int)mFrameWidth;
+    if(mWidth > 0)
+        return mWidth;
+    return (unsigned int)(settings->cropWidth > 0 ? settings->cropWidth : mCaptureWidth);
 }
 
 unsigned int
 DLCapture::getHeight(void)
 {
-    return mHeight;
+    SettingsPtr settings = GetSettings();
+
+    mutex::scoped_lock l(mDimensionsMutex);
+    if(mFrameHeight > 0)
+        return (unsigned int)mFrameHeight;
+    if(mHeight > 0)
+        return mHeight;
+    return (unsigned int)(settings->cropHeight > 0 ? settings->cropHeight : mCaptureHeight);
 }
 
-void
+// 0x0 (or anything not positive) goes back to frames the size of the crop,
+// or of the whole capture with no crop. 16-bit YUV can't be scaled (OpenCV
+// would average U and V into each other), so it only comes at that size.
+bool
 DLCapture::setSize(int width, int height)
 {
+    SettingsPtr settings = GetSettings();
+
+    if(width <= 0 || height <= 0) {
+        width = height = 0;
+    } else if(settings->colorspace == DLFrame::DL_YUV16) {
+        long source_width  = settings->cropWidth  > 0 ? settings->cropWidth  : (long)getCaptureWidth();
+        long source_height = settings->cropHeight > 0 ? settings->cropHeight : (long)getCaptureHeight();
+        if(source_width > 0 && (width != source_width || height != source_height)) {
+            ofLog(OF_LOG_WARNING, "DLCapture::setSize - 16-bit YUV frames can't be scaled, keeping them at %ldx%ld",
+                  source_width, source_height);
+            return false;
+        }
+    }
+
+    mutex::scoped_lock l(mDimensionsMutex);
     mWidth  = width;
     mHeight = height;
+    return true;
+}
+
+// What the display mode says the capture will be, so the size is known
+// before the first frame arrives. That frame has the final say.
+void
+DLCapture::setModeSize(int width, int height)
+{
+    mutex::scoped_lock l(mDimensionsMutex);
+    mCaptureWidth   = width;
+    mCaptureHeight  = height;
+    // frames from the last run say nothing about this one
+    mFrameWidth     = 0;
+    mFrameHeight    = 0;
 }
 
 unsigned int
 DLCapture::getCaptureWidth(void)
 {
+    mutex::scoped_lock l(mDimensionsMutex);
     return (unsigned int) mCaptureWidth;
 }
 
 unsigned int
 DLCapture::getCaptureHeight(void)
 {
+    mutex::scoped_lock l(mDimensionsMutex);
     return (unsigned int) mCaptureHeight;
 }
 
-void
-DLCapture::InitialiseDimensions(IDeckLinkVideoInputFrame* pArrivedFrame)
-{
-    mCaptureWidth      = pArrivedFrame->GetWidth();
-    mCaptureHeight     = pArrivedFrame->GetHeight();
-    mCaptureRowBytes   = pArrivedFrame->GetRowBytes();
-    mCaptureTotalBytes = mCaptureRowBytes * mCaptureHeight;
-
-	// bend over backwards to send memory aligned work units to each thread
-	// NOTE: I'm sure there's a more elegant way to split up this 
-	//       work to make it memory aligned, but I'm not smart enough
-	//       to figure it out today...
-    mConversionChunkSize = mCaptureRowBytes * (long)ceil(mCaptureHeight / (float)getThreadpoolSize());
-	// calculate whether the last chunk will be memory aligned or not and set its size
-	if(mCaptureHeight % getThreadpoolSize() == 0)
-		mConversionChunkSizeLeftover = mConversionChunkSize;
-	else
-		mConversionChunkSizeLeftover = mCaptureTotalBytes % mConversionChunkSize;
+// Works out where the crop sits in this frame. The left edge gets moved back
+// to the start of a pixel group (a UYVY pair or a 6 pixel v210 group) and a
+// crop that hangs off the frame is trimmed to fit. Everything comes from the
+// frame itself: with more than one frame in flight, a format change can
+// land between two frames that are still being converted.
+DLCapture::Region
+DLCapture::CropRegion(IDeckLinkVideoInputFrame* pArrivedFrame, const Settings &settings)
+{
+    long frame_width  = pArrivedFrame->GetWidth();
+    long frame_height = pArrivedFrame->GetHeight();
+
+    Region region;
+    pArrivedFrame->GetBytes((void**)&region.bytes);
+    region.width    = frame_width;
+    region.height   = frame_height;
+    region.rowBytes = pArrivedFrame->GetRowBytes();
+    region.format   = pArrivedFrame->GetPixelFormat();
+
+    if(settings.cropWidth <= 0 || settings.cropHeight <= 0)
+        return region;
+
+    long x = min(settings.cropX, frame_width - 2);
+    long y = min(settings.cropY, frame_height - 1);
+    long x_bytes;
+
+    switch(region.format) {
+        case bmdFormat10BitYUV:
+            x -= x % 6;
+            x_bytes = x / 6 * 16;
+            break;
+        case bmdFormat8BitARGB:
+        case bmdFormat8BitBGRA:
+        case bmdFormat10BitRGB:
+            x_bytes = x * 4;
+            break;
+        default:
+            x_bytes = x * 2;
+            break;
+    }
 
-	// precalculate some stuff
-	mGrayscaleTotalBytes = mCaptureWidth * mCaptureHeight;
-    mRgbRowBytes         = mCaptureWidth * 3;
+    region.bytes   += y * region.rowBytes + x_bytes;
+    region.width    = min(settings.cropWidth, (frame_width - x) & ~1L);
+    region.height   = min(settings.cropHeight, frame_height - y);
+    return region;
+}
+
+// RGB formats from the card stay RGB, YUV goes to whatever was asked for.
+// 10-bit RGB can come out in any of the 8-bit RGB layouts or as 16-bit RGB.
+DLFrame::ColorSpace
+DLCapture::OutputColorspace(BMDPixelFormat format, const Settings &settings)
+{
+    switch(format) {
+        case bmdFormat8BitARGB:
+        case bmdFormat8BitBGRA:
+            return DLFrame::DL_BGRA;
+        case bmdFormat10BitRGB:
+            switch(settings.colorspace) {
+                case DLFrame::DL_RGBA:
+                case DLFrame::DL_BGRA:
+                case DLFrame::DL_RGB16:
+                    return settings.colorspace;
+                default:
+                    return DLFrame::DL_RGB;
+            }
+        default:
+            return settings.colorspace;
+    }
+}
+
+// input and output bytes a band of rows should touch, about a core's share
+// of L2
+static const long BAND_BYTES = 256 * 1024;
+
+// Rows per band. Bands are small enough that a frame is a few dozen of
+// them (a 1080p UYVY to RGB row is ~9.4 KB), so a worker that gets
+// preempted or runs on a slower core just ends up taking fewer. Rows can be
+// padded (v210 rows are rounded up to 48 pixels) so splitting on byte
+// counts doesn't work. 4:2:0 output converts rows in pairs, so bands have
+// to start on even rows.
+long
+DLCapture::BandRows(long numRows, long bytesPerRow)
+{
+    long rows = BAND_BYTES / max(bytesPerRow, 1L);
+
+    // small frames still get a few bands per worker
+    rows = min(rows, (long)ceil(numRows / (4.0f * getThreadpoolSize())));
+    return max(rows & ~1L, 2L);
 }
 
 bool
@@ -170,6 +330,24 @@ DLCapture::getFrame(shared_ptr<DLFrame> &frame)
 	return fifo.Consume(frame);
 }
 
+// Like getFrame, but if there's nothing yet it sleeps until a frame is
+// published or timeoutMs runs out, instead of the caller polling.
+bool
+DLCapture::waitForFrame(shared_ptr<DLFrame> &frame, unsigned int timeoutMs)
+{
+    if(fifo.Consume(frame))
+        return true;
+
+    system_time deadline = get_system_time() + posix_time::milliseconds(timeoutMs);
+
+    mutex::scoped_lock l(mFrameReadyMutex);
+    while(!fifo.Consume(frame)) {
+        if(!mFrameReady.timed_wait(l, deadline))
+            return fifo.Consume(frame);
+    }
+    return true;
+}
+
 long
 DLCapture::getFrameCount(void)
 {
@@ -198,49 +376,684 @@ DLCapture::setThreadpoolSize(unsigned int size)
     if(size < 1) size = 1;
     conversion_workers.size_controller().resize(size);
 }
-    
-// TODO: take care of the fact that frames might get out of order? There's
-//       no guarantee that threads will process these suckers in order, we'd
-//       need to keep track of the frame number in DLFrame and make
-//       the grabFrame() method smart enought to enforce ordering -- but how
-//       do we do that with the potential for droppped frames?
+
+unsigned int
+DLCapture::getPipelineDepth(void)
+{
+    mutex::scoped_lock l(mPipelineMutex);
+    return mPipelineDepth;
+}
+
+// How many arrived frames can queue up behind the one being converted. More
+// rides out the odd slow frame, fewer keeps the latency (and the number of
+// card buffers tied up) down.
+void
+DLCapture::setPipelineDepth(unsigned int depth)
+{
+    mutex::scoped_lock l(mPipelineMutex);
+    mPipelineDepth = max(depth, 1u);
+
+    while(mPending.size() > mPipelineDepth)
+        DropOldestPending();
+}
+
+// gives the oldest waiting frame's buffer back to the card, the reorder
+// stage skips its sequence number. mPipelineMutex has to be held.
+void
+DLCapture::DropOldestPending(void)
+{
+    mPending.front().frame->Release();
+    Deliver(mPending.front().sequence, shared_ptr<DLFrame>());
+    mPending.pop_front();
+    mDroppedFrames++;
+}
+
+long
+DLCapture::getDroppedFrameCount(void)
+{
+    long dropped;
+    {
+        mutex::scoped_lock l(mPipelineMutex);
+        dropped = mDroppedFrames;
+    }
+    mutex::scoped_lock l(mReorderMutex);
+    return dropped + mLateFrames;
+}
+
+unsigned int
+DLCapture::getPipelinePeak(void)
+{
+    mutex::scoped_lock l(mPipelineMutex);
+    return mPipelinePeak;
+}
+
+DWORD_PTR
+DLCapture::getCpuAffinity(void)
+{
+    mutex::scoped_lock l(mPlacementMutex);
+    return mAffinity;
+}
+
+// Keeps the conversion stage and the workers on the given CPUs, so on a
+// multi-socket machine they stay next to the card and each other. Threads
+// pick up a change the next time they start on a frame. The mask is in the
+// process's processor group, like SetThreadAffinityMask's.
 void
-DLCapture::PostProcess(IDeckLinkVideoInputFrame* pArrivedFrame)
+DLCapture::setCpuAffinity(DWORD_PTR mask)
 {
-    // post-process the preview frame
-    // if(mCaptureHeight == mHeight || mCaptureWidth == mWidth){
-    //     fifo.Produce(YuvToGrayscale(pArrivedFrame));
-    // } else {
-    //     fifo.Produce(Resize(YuvToGrayscale(pArrivedFrame), mWidth, mHeight));
-    // }
+    mutex::scoped_lock l(mPlacementMutex);
+    mAffinity = mask;
+}
+
+int
+DLCapture::getNumaNode(void)
+{
+    mutex::scoped_lock l(mPlacementMutex);
+    return mNumaNode;
+}
+
+// Pins the conversion threads to a NUMA node's CPUs and allocates converted
+// frames from its memory. Pick the node the card's PCIe slot is attached to,
+// so the card's buffers, the threads reading them and the frames they write
+// all stay on one socket. -1 goes back to any CPU and any memory.
+bool
+DLCapture::setNumaNode(int node)
+{
+    DWORD_PTR mask = 0;
+
+    if(node >= 0) {
+        ULONG     highest;
+        ULONGLONG node_mask;
+
+        if(!GetNumaHighestNodeNumber(&highest) || (ULONG)node > highest ||
+           !GetNumaNodeProcessorMask((UCHAR)node, &node_mask) || node_mask == 0) {
+            ofLog(OF_LOG_ERROR, "DLCapture - NUMA node %d doesn't exist or has no processors", node);
+            return false;
+        }
+        mask = (DWORD_PTR)node_mask;
+    }
+
+    mutex::scoped_lock l(mPlacementMutex);
+    mNumaNode  = max(node, -1);
+    mAffinity  = mask;
+    return true;
+}
+
+// output frames come from the NUMA node's memory when there is one
+shared_ptr<DLFrame>
+DLCapture::NewFrame(long width, long height, long rowBytes, DLFrame::ColorSpace colorspace)
+{
+    int node = getNumaNode();
+    if(node < 0)
+        return shared_ptr<DLFrame>(new DLFrame(width, height, rowBytes, colorspace));
+    return shared_ptr<DLFrame>(new DLFrame(width, height, rowBytes, colorspace, node));
+}
+
+unsigned int
+DLCapture::getFramesInFlight(void)
+{
+    mutex::scoped_lock l(mPipelineMutex);
+    return mFramesInFlight;
+}
+
+// More than one frame in flight lets a frame start converting before the
+// previous one is done, which helps when a single frame can't keep the
+// workers busy. Stage threads are only ever added; the ones past the limit
+// just sit idle.
+void
+DLCapture::setFramesInFlight(unsigned int frames)
+{
+    mutex::scoped_lock l(mPipelineMutex);
+    mFramesInFlight = max(frames, 1u);
+
+    while(mPipelineThreads.size() < mFramesInFlight)
+        mPipelineThreads.create_thread(bind(&DLCapture::RunPipeline, this, (unsigned int)mPipelineThreads.size()));
+
+    mPipelineReady.notify_all();
+}
+
+DLCapture::SettingsPtr
+DLCapture::GetSettings(void)
+{
+    mutex::scoped_lock l(mSettingsMutex);
+    return mSettings;
+}
+
+// which RGB kernel writes a colorspace
+static DLConvert::Layout
+RgbLayout(DLFrame::ColorSpace colorspace)
+{
+    switch(colorspace) {
+        case DLFrame::DL_RGBA: return DLConvert::LAYOUT_RGBA;
+        case DLFrame::DL_BGRA: return DLConvert::LAYOUT_BGRA;
+        default:               return DLConvert::LAYOUT_RGB;
+    }
+}
+
+// The lookup tables only depend on the colorimetry, so there's one set of
+// each for the whole process. They're built the first time any capture asks
+// for them and kept until exit, so re-creating a capture (or switching the
+// method back and forth) doesn't pay for them again.
+static mutex                                        lookup_tables_mutex;
+static shared_ptr<const DLConvert::LookupTables>    lookup_tables[2][2][2];    // [matrix][input range][output range]
+
+static shared_ptr<const DLConvert::LookupTables>
+SharedLookupTables(const DLConvert::Colorimetry &colorimetry)
+{
+    mutex::scoped_lock l(lookup_tables_mutex);
+
+    shared_ptr<const DLConvert::LookupTables> &tables =
+        lookup_tables[colorimetry.matrix][colorimetry.inputRange][colorimetry.outputRange];
+
+    if(!tables) {
+        shared_ptr<DLConvert::LookupTables> built(new DLConvert::LookupTables);
+        DLConvert::CreateLookupTables(*built, colorimetry);
+        tables = built;
+    }
+    return tables;
+}
+
+// fills in everything derived from the user facing settings and publishes them
+void
+DLCapture::ApplySettings(Settings settings)
+{
+    settings.uyvyToRgb    = DLConvert::GetUyvyToRgb(mIsa, settings.colorimetry, RgbLayout(settings.colorspace), settings.chroma);
+    settings.uyvyToGray   = DLConvert::GetUyvyToGray(mIsa);
+    settings.v210ToUyvy   = DLConvert::GetV210ToUyvy(mIsa);
+    settings.v210ToUyvy16 = DLConvert::GetV210ToUyvy16(mIsa);
+    settings.v210ToGray   = DLConvert::GetV210ToGray(mIsa);
+    settings.v210ToGray16 = DLConvert::GetV210ToGray16(mIsa);
+    settings.uyvy16ToRgb16 = DLConvert::GetUyvy16ToRgb16(mIsa, settings.colorimetry);
+    settings.argbToBgra   = DLConvert::GetArgbToBgra(mIsa);
+    settings.r210ToRgb    = DLConvert::GetR210ToRgb(mIsa, settings.colorimetry, RgbLayout(settings.colorspace));
+    settings.r210ToRgb16  = DLConvert::GetR210ToRgb16(mIsa);
+    settings.applyLut3D   = DLConvert::GetApplyLut3D(mIsa, RgbLayout(settings.colorspace));
+    settings.bgraLut3D    = DLConvert::GetApplyLut3D(mIsa, DLConvert::LAYOUT_BGRA);
+    settings.toneMapRow   = DLConvert::GetUyvy16ToneMap(mIsa, RgbLayout(settings.colorspace));
+    settings.accumulateRow = DLConvert::GetAccumulateRow(mIsa);
+    settings.boxDownscale = DLConvert::GetUyvyBoxDownscale(mIsa);
+    settings.uyvyTo420    = (settings.colorspace == DLFrame::DL_I420) ? DLConvert::GetUyvyToI420(mIsa)
+                                                                      : DLConvert::GetUyvyToNv12(mIsa);
+
+    bool half   = (settings.colorspace == DLFrame::DL_RGB16F || settings.colorspace == DLFrame::DL_RGB16F_PLANAR);
+    bool planar = (settings.colorspace == DLFrame::DL_RGB32F_PLANAR || settings.colorspace == DLFrame::DL_RGB16F_PLANAR);
+    settings.uyvyToFloat  = DLConvert::GetUyvyToFloat(mIsa,
+                                                      settings.colorimetry,
+                                                      half ? DLConvert::FLOAT_16 : DLConvert::FLOAT_32,
+                                                      planar);
+
+    // build the tables before taking the lock so we don't stall the
+    // conversion of frames that are in flight
+    if(settings.method != DLConvert::METHOD_LOOKUP_TABLE) {
+        settings.tables.reset();
+    } else if(!settings.tables || settings.tables->colorimetry != settings.colorimetry) {
+        settings.tables = SharedLookupTables(settings.colorimetry);
+    }
+
+    // the tone mapping tables have the input range folded in
+    if(settings.toneMap && settings.toneMap->colorimetry != settings.colorimetry) {
+        shared_ptr<DLConvert::ToneMapTables> tables(new DLConvert::ToneMapTables);
+        DLConvert::CreateToneMapTables(*tables, settings.toneMap->mapping, settings.colorimetry);
+        settings.toneMap = tables;
+    }
+
+    mutex::scoped_lock l(mSettingsMutex);
+    mSettings.reset(new Settings(settings));
+}
+
+DLConvert::Method
+DLCapture::getConversionMethod(void)
+{
+    return GetSettings()->method;
+}
+
+void
+DLCapture::setConversionMethod(DLConvert::Method method)
+{
+    Settings settings = *GetSettings();
+    settings.method = method;
+    ApplySettings(settings);
+}
+
+DLConvert::Colorimetry
+DLCapture::getColorimetry(void)
+{
+    return GetSettings()->colorimetry;
+}
+
+void
+DLCapture::setColorimetry(const DLConvert::Colorimetry &colorimetry)
+{
+    Settings settings = *GetSettings();
+    settings.colorimetry = colorimetry;
+    ApplySettings(settings);
+}
+
+DLConvert::ChromaUpsampling
+DLCapture::getChromaUpsampling(void)
+{
+    return GetSettings()->chroma;
+}
+
+// Linear chroma isn't free: averaging the red, green and blue chroma terms
+// for every odd pixel makes the RGB conversion about 24% slower with AVX2
+// and 28% with SSSE3 (convertBenchmark, uyvy-rgb-linear against uyvy-rgb).
+void
+DLCapture::setChromaUpsampling(DLConvert::ChromaUpsampling chroma)
+{
+    Settings settings = *GetSettings();
+    settings.chroma = chroma;
+    ApplySettings(settings);
+}
+
+DLFrame::ColorSpace
+DLCapture::getColorspace(void)
+{
+    return GetSettings()->colorspace;
+}
+
+bool
+DLCapture::setColorspace(DLFrame::ColorSpace colorspace)
+{
+    switch(colorspace) {
+        case DLFrame::DL_GRAYSCALE:
+        case DLFrame::DL_RGB:
+        case DLFrame::DL_YUV16:
+        case DLFrame::DL_RGBA:
+        case DLFrame::DL_BGRA:
+        case DLFrame::DL_NV12:
+        case DLFrame::DL_I420:
+        case DLFrame::DL_RGB32F:
+        case DLFrame::DL_RGB16F:
+        case DLFrame::DL_RGB32F_PLANAR:
+        case DLFrame::DL_RGB16F_PLANAR:
+        case DLFrame::DL_RGB16:
+        case DLFrame::DL_GRAY16:
+            break;
+        default:
+            ofLog(OF_LOG_ERROR, "DLCapture::setColorspace - unsupported output colorspace");
+            return false;
+    }
+
+    Settings settings = *GetSettings();
+    settings.colorspace = colorspace;
+    ApplySettings(settings);
+    return true;
+}
+
+DLConvert::Normalization
+DLCapture::getNormalization(void)
+{
+    return GetSettings()->normalization;
+}
+
+void
+DLCapture::setNormalization(const DLConvert::Normalization &normalization)
+{
+    Settings settings = *GetSettings();
+    settings.normalization = normalization;
+    ApplySettings(settings);
+}
 
-    if(mCaptureHeight == mHeight || mCaptureWidth == mWidth){
-        fifo.Produce(YuvToRgb(pArrivedFrame));
+void
+DLCapture::getCrop(int &x, int &y, int &width, int &height)
+{
+    SettingsPtr settings = GetSettings();
+    x      = (int)settings->cropX;
+    y      = (int)settings->cropY;
+    width  = (int)settings->cropWidth;
+    height = (int)settings->cropHeight;
+}
+
+// Without a size from setSize() frames follow the crop, otherwise the crop
+// gets scaled to that size. Pixels come in pairs so x and width get rounded
+// down to even numbers.
+void
+DLCapture::setCrop(int x, int y, int width, int height)
+{
+    Settings settings = *GetSettings();
+
+    if(width < 2 || height < 1) {
+        settings.cropX = settings.cropY = settings.cropWidth = settings.cropHeight = 0;
     } else {
-       fifo.Produce(Resize(YuvToRgb(pArrivedFrame), mWidth, mHeight));
+        settings.cropX      = max(x, 0) & ~1;
+        settings.cropY      = max(y, 0);
+        settings.cropWidth  = width & ~1;
+        settings.cropHeight = height;
     }
 
+    ApplySettings(settings);
+}
+
+// The LUT gets applied to each row right after it's converted, while the row
+// is still in cache, so grading doesn't cost another pass over the frame.
+bool
+DLCapture::loadLut3D(const std::string &path)
+{
+    std::ifstream file(path.c_str());
+    if(!file) {
+        ofLog(OF_LOG_ERROR, "DLCapture::loadLut3D - can't open %s", path.c_str());
+        return false;
+    }
+
+    shared_ptr<DLConvert::Lut3D> lut(new DLConvert::Lut3D);
+    std::string                  error;
+    if(!DLConvert::ParseCube(file, *lut, error)) {
+        ofLog(OF_LOG_ERROR, "DLCapture::loadLut3D - %s: %s", path.c_str(), error.c_str());
+        return false;
+    }
+
+    Settings settings = *GetSettings();
+    settings.lut3D = lut;
+    ApplySettings(settings);
+    return true;
+}
+
+void
+DLCapture::clearLut3D(void)
+{
+    Settings settings = *GetSettings();
+    settings.lut3D.reset();
+    ApplySettings(settings);
+}
+
+void
+DLCapture::setToneMapping(const DLConvert::ToneMapping &mapping)
+{
+    Settings settings = *GetSettings();
+
+    shared_ptr<DLConvert::ToneMapTables> tables(new DLConvert::ToneMapTables);
+    DLConvert::CreateToneMapTables(*tables, mapping, settings.colorimetry);
+    settings.toneMap = tables;
+    ApplySettings(settings);
+}
+
+void
+DLCapture::clearToneMapping(void)
+{
+    Settings settings = *GetSettings();
+    settings.toneMap.reset();
+    ApplySettings(settings);
+}
+    
+// the mask each thread last pinned itself to, 0 if it never has
+static thread_specific_ptr<DWORD_PTR> pinned_mask;
+
+// Moves the calling thread onto mask's CPUs (any of the process's for 0).
+// Only goes to the OS when the mask changes, so it's cheap to call per frame.
+static void
+PinThread(DWORD_PTR mask)
+{
+    if(!pinned_mask.get())
+        pinned_mask.reset(new DWORD_PTR(0));
+    if(*pinned_mask == mask)
+        return;
+
+    DWORD_PTR cpus = mask, process_mask, system_mask;
+    if(!cpus && GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        cpus = process_mask;
+    if(cpus)
+        SetThreadAffinityMask(GetCurrentThread(), cpus);
+    *pinned_mask = mask;
+}
+
+// One conversion stage thread. Takes frames off mPending oldest first;
+// with more than one frame in flight they can finish in any order, Deliver
+// sorts that out.
+void
+DLCapture::RunPipeline(unsigned int index)
+{
+    for(;;) {
+        PendingFrame pending;
+        {
+            mutex::scoped_lock l(mPipelineMutex);
+            while((mPending.empty() || index >= mFramesInFlight) && !mPipelineStop)
+                mPipelineReady.wait(l);
+            if(mPipelineStop)
+                return;
+            pending = mPending.front();
+            mPending.pop_front();
+        }
+
+        PinThread(getCpuAffinity());
+        PostProcess(pending.frame, pending.sequence);
+    }
+}
+
+// how long finished frames wait for an earlier one before it's given up on
+static const float REORDER_TIMEOUT = 0.1f;  // seconds
+
+// The reorder stage. Frames go into fifo strictly in capture order: a frame
+// that finishes early waits in mReorder until everything before it has
+// either been delivered or skipped (an empty frame). If the frame at the
+// head takes longer than REORDER_TIMEOUT, it's skipped and thrown away when
+// it does finish. The timeout is only checked when a frame is delivered,
+// which happens every frame period while capturing.
+void
+DLCapture::Deliver(long sequence, shared_ptr<DLFrame> frame)
+{
+    mutex::scoped_lock l(mReorderMutex);
+
+    if(sequence < mNextSequence) {
+        if(frame)
+            mLateFrames++;
+        return;
+    }
+    mReorder[sequence] = frame;
+
+    float now = ofGetElapsedTimef();
+    if(mReorderStall >= 0 && now - mReorderStall > REORDER_TIMEOUT)
+        mNextSequence = mReorder.begin()->first;
+
+    bool published = false;
+    while(!mReorder.empty() && mReorder.begin()->first == mNextSequence) {
+        if(mReorder.begin()->second) {
+            // in capture order, so a frame that finishes late can't leave
+            // the getters on a size that's already been replaced
+            {
+                mutex::scoped_lock d(mDimensionsMutex);
+                mFrameWidth  = mReorder.begin()->second->width;
+                mFrameHeight = mReorder.begin()->second->height;
+            }
+            fifo.Produce(mReorder.begin()->second);
+            published = true;
+        }
+        mReorder.erase(mReorder.begin());
+        mNextSequence++;
+        mReorderStall = -1;
+    }
+
+    // still waiting on an earlier frame, start the clock
+    if(!mReorder.empty() && mReorderStall < 0)
+        mReorderStall = now;
+
+    // wake up waitForFrame. Taking the lock means a consumer that's just
+    // found fifo empty is already waiting by the time we notify.
+    if(published) {
+        mutex::scoped_lock f(mFrameReadyMutex);
+        mFrameReady.notify_all();
+    }
+}
+
+void
+DLCapture::PostProcess(IDeckLinkVideoInputFrame* pArrivedFrame, long sequence)
+{
+    // the whole frame gets converted with the same settings, geometry and
+    // output size, whatever happens to the next one
+    SettingsPtr         settings = GetSettings();
+    Region              src      = CropRegion(pArrivedFrame, *settings);
+    shared_ptr<DLFrame> frame;
+    long                width, height, last_width, last_height;
+    {
+        mutex::scoped_lock l(mDimensionsMutex);
+        mCaptureWidth  = pArrivedFrame->GetWidth();
+        mCaptureHeight = pArrivedFrame->GetHeight();
+        width          = mWidth  > 0 ? (long)mWidth  : src.width;
+        height         = mHeight > 0 ? (long)mHeight : src.height;
+        last_width     = mFrameWidth;
+        last_height    = mFrameHeight;
+    }
+
+    switch(src.format) {
+        case bmdFormat8BitBGRA:
+            // the card already did the color conversion, hand out its buffer.
+            // Grading needs a copy to write to.
+            if(settings->lut3D)
+                frame = Convert(src, settings);
+            else
+                frame = Wrap(pArrivedFrame, src, DLFrame::DL_BGRA);
+            break;
+        case bmdFormat8BitYUV:
+        case bmdFormat10BitYUV:
+            // scaling down before the color conversion saves converting
+            // pixels that would only get thrown away
+            if((width != src.width || height != src.height) && CanScaleInYuv(src, *settings, width, height))
+                frame = ConvertScaled(src, settings, width, height);
+            else
+                frame = Convert(src, settings);
+            break;
+        case bmdFormat8BitARGB:
+        case bmdFormat10BitRGB:
+            frame = Convert(src, settings);
+            break;
+        default:
+            ofLog(OF_LOG_ERROR, "DLCapture - can't convert this pixel format, dropping frame");
+            break;
+    }
+
+    if(frame) {
+        if(frame->height != height || frame->width != width)
+            frame = Resize(frame, width, height);
+
+        // Whatever couldn't be scaled goes out at the size it is. The size
+        // asked for stays put, so it comes back once the colorspace can be
+        // scaled again, and getWidth()/getHeight() go by the frames. Only
+        // the first frame to change size gets a warning.
+        if((frame->height != height || frame->width != width) &&
+           (frame->height != last_height || frame->width != last_width))
+            ofLog(OF_LOG_WARNING, "DLCapture - can't scale this colorspace to %ldx%ld, frames stay %ldx%ld",
+                  width, height, frame->width, frame->height);
+        frame->sequence = sequence;
+    }
+
+    // an empty frame still has to go through, so the ones after it don't
+    // wait for it
+    Deliver(sequence, frame);
+
     // free up the frame reference
     pArrivedFrame->Release();
 }
 
+// releases a Decklink frame once the last DLFrame using its buffer goes away
+struct ReleaseDeckLinkFrame
+{
+    void operator()(IDeckLinkVideoInputFrame* pFrame) const { pFrame->Release(); }
+};
+
+// NOTE: the card only has a handful of frame buffers. Every wrapped frame
+//       that's sitting in the fifo (or held by the app) keeps one of them
+//       busy, so the driver will start dropping frames if they pile up.
 shared_ptr<DLFrame>
-DLCapture::YuvToGrayscale(IDeckLinkVideoInputFrame* pArrivedFrame)
+DLCapture::Wrap(IDeckLinkVideoInputFrame* pArrivedFrame, const Region &src, DLFrame::ColorSpace colorspace)
 {
-    // TODO: don't assum YUV here
-    BYTE* yuv;
-    pArrivedFrame->GetBytes((void**)&yuv);
+    pArrivedFrame->AddRef();
+    shared_ptr<void> owner(pArrivedFrame, ReleaseDeckLinkFrame());
 
-    shared_ptr<DLFrame> grayscale(new DLFrame(mCaptureWidth, mCaptureHeight, mCaptureWidth, DLFrame::DL_GRAYSCALE));
-    
-    // simple YUV -> Grayscale, just throw away the U and V channels
-    for(int i=0; i<mGrayscaleTotalBytes; i++)
-        grayscale->pixels[i] = yuv[(i*2)+1];
+    // a crop is just a different starting point in the card's buffer
+    return shared_ptr<DLFrame>(new DLFrame(src.bytes, src.width, src.height, src.rowBytes, colorspace, owner));
+}
+
+// Counts down the chunks of one frame. conversion_workers.wait() would wait
+// for every chunk in the pool, including other frames' ones, so each frame
+// waits on its own latch instead and the workers go straight on to the next
+// frame's chunks.
+class ChunkLatch
+{
+public:
+    explicit ChunkLatch(long count) : mRemaining(count) {}
+
+    void countDown(void)
+    {
+        mutex::scoped_lock l(mMutex);
+        if(--mRemaining == 0)
+            mDone.notify_all();
+    }
+
+    void wait(void)
+    {
+        mutex::scoped_lock l(mMutex);
+        while(mRemaining > 0)
+            mDone.wait(l);
+    }
+
+private:
+    mutex               mMutex;
+    condition_variable  mDone;
+    long                mRemaining;
+};
+
+// a chunk for the pool that counts itself off its frame's latch
+struct LatchedChunk
+{
+    LatchedChunk(const function<void()> &chunk, shared_ptr<ChunkLatch> latch) : chunk(chunk), latch(latch) {}
+    void operator()() const { chunk(); latch->countDown(); }
+
+    function<void()>        chunk;
+    shared_ptr<ChunkLatch>  latch;
+};
+
+// The bands of one frame. Workers take the next one with a single atomic
+// add, so whoever is free first gets it.
+class RowBands
+{
+public:
+    RowBands(long numRows, long bandRows) : mNext(0), mNumRows(numRows), mBandRows(bandRows) {}
+
+    bool take(long &firstRow, long &numRows)
+    {
+        long band = InterlockedIncrement(&mNext) - 1;
+        firstRow = band * mBandRows;
+        if(firstRow >= mNumRows)
+            return false;
+        numRows = min(mBandRows, mNumRows - firstRow);
+        return true;
+    }
+
+private:
+    volatile LONG   mNext;
+    long            mNumRows;
+    long            mBandRows;
+};
+
+// one worker's part of a frame, bands until there are none left
+static void
+RunBands(shared_ptr<RowBands> bands, function<void(long, long)> chunk, DWORD_PTR affinity)
+{
+    PinThread(affinity);
+
+    long first, count;
+    while(bands->take(first, count))
+        chunk(first, count);
+}
+
+// Converts a frame's rows with chunk(firstRow, numRows) on every worker and
+// returns when they're all done. Each worker keeps pulling bands until the
+// frame runs out, so the load balances itself.
+void
+DLCapture::ConvertBands(long numRows, long bytesPerRow, const function<void(long, long)> &chunk)
+{
+    long                    workers = getThreadpoolSize();
+    DWORD_PTR               affinity = getCpuAffinity();
+    shared_ptr<RowBands>    bands(new RowBands(numRows, BandRows(numRows, bytesPerRow)));
+    shared_ptr<ChunkLatch>  done(new ChunkLatch(workers));
+
+    for(long i=0; i<workers; i++)
+        conversion_workers.schedule(LatchedChunk(bind(&RunBands, bands, chunk, affinity), done));
 
-    return grayscale;
+    done->wait();
 }
 
-// YUV format conforms to ITU.BT-601
+// YUV format conforms to ITU.BT-601 or ITU.BT-709, see DLConvert::Colorimetry
 //
 // http://www.fourcc.org/yuv.php#UYVY
 // http://www.martinreddy.net/gfx/faqs/colorconv.faq
@@ -257,173 +1070,352 @@ DLCapture::YuvToGrayscale(IDeckLinkVideoInputFrame* pArrivedFrame)
 // B = 1.164(Y - 16) + 2.115(Cb - 128)
 
 shared_ptr<DLFrame>
-DLCapture::YuvToRgb(IDeckLinkVideoInputFrame* pArrivedFrame)
+DLCapture::Convert(const Region &src, SettingsPtr settings)
 {
-    BYTE* yuv;
-    pArrivedFrame->GetBytes((void**)&yuv);
+    DLFrame::ColorSpace colorspace = OutputColorspace(src.format, *settings);
 
-    // allocate space for the rgb image
-    shared_ptr<DLFrame> rgb(new DLFrame(mCaptureWidth, mCaptureHeight, mRgbRowBytes, DLFrame::DL_RGB));
+    // allocate space for the converted image
+    shared_ptr<DLFrame> frame = NewFrame(src.width,
+                                         src.height,
+                                         DLFrame::packedRowBytes(colorspace, src.width),
+                                         colorspace);
 
-    int num_workers = conversion_workers.size() - 1;
+    // split up the image into bands of rows so each worker streams through
+    // its own piece of memory
+    ConvertBands(src.height,
+                 src.rowBytes + frame->getRowBytes(),
+                 bind(&DLCapture::ConvertChunk, this, src, frame, settings, _1, _2));
 
-    // split up the image into memory-aligned chunks so they take advantage of
-    // the CPU cache
-	for(int i=0; i<num_workers; i++) {
-        conversion_workers.schedule(bind(&DLCapture::YuvToRgbChunk,
-                                         this,
-                                         yuv,
-                                         rgb,
-                                         mConversionChunkSize*i,
-                                         mConversionChunkSize));
-	}
+    return frame;
+}
+
+void 
+DLCapture::ConvertChunk(Region src, shared_ptr<DLFrame> frame, SettingsPtr settings, long firstRow, long numRows)
+{
+    DLFrame::ColorSpace out = frame->getNativeType();
+
+    if(out == DLFrame::DL_NV12 || out == DLFrame::DL_I420) {
+        ConvertChunk420(src, frame, settings, firstRow, numRows);
+        return;
+    }
 
-    // get the off-sized leftover chunk and schedule it
-    conversion_workers.schedule(bind(&DLCapture::YuvToRgbChunk,
-                                     this,
-                                     yuv,
-                                     rgb,
-                                     mConversionChunkSize*num_workers,
-                                     mConversionChunkSizeLeftover));
+    bool               is_v210 = (src.format == bmdFormat10BitYUV);
+    std::vector<BYTE>  uyvy;    // v210 rows get unpacked here before RGB conversion
+
+    // 16-bit RGB and tone mapped RGB go through 16-bit UYVY whatever the
+    // input, everything else only needs v210 rounded to 8-bit UYVY
+    bool tone_mapped = settings->toneMap && (out == DLFrame::DL_RGB || out == DLFrame::DL_RGBA || out == DLFrame::DL_BGRA);
+
+    if(out == DLFrame::DL_RGB16 || tone_mapped)
+        uyvy.resize(DLFrame::packedRowBytes(DLFrame::DL_YUV16, src.width));
+    else if(is_v210 && out != DLFrame::DL_GRAYSCALE && out != DLFrame::DL_GRAY16 && out != DLFrame::DL_YUV16)
+        uyvy.resize(DLFrame::packedRowBytes(DLFrame::DL_YUV16, src.width) / 2);
+
+    for(long row=firstRow; row<firstRow+numRows; row++) {
+        const BYTE *line = src.bytes + row * src.rowBytes;
+
+        // RGB from the card only needs its bytes put in the order GL and
+        // OpenCV like (BGRA only gets here to be graded)
+        if(src.format == bmdFormat8BitARGB || src.format == bmdFormat8BitBGRA) {
+            BYTE *dst = frame->pixels + row * frame->getRowBytes();
+            if(src.format == bmdFormat8BitARGB)
+                settings->argbToBgra(line, dst, src.width);
+            else
+                memcpy(dst, line, src.width * 4);
+            if(settings->lut3D)
+                settings->bgraLut3D(*settings->lut3D, dst, src.width);
+            continue;
+        }
 
-    conversion_workers.wait();
+        if(src.format == bmdFormat10BitRGB) {
+            BYTE *dst = frame->pixels + row * frame->getRowBytes();
+            if(out == DLFrame::DL_RGB16) {
+                settings->r210ToRgb16(line, dst, src.width);
+            } else {
+                settings->r210ToRgb(line, dst, src.width);
+                if(settings->lut3D)
+                    settings->applyLut3D(*settings->lut3D, dst, src.width);
+            }
+            continue;
+        }
 
-    return rgb;
+        ConvertRow(line, is_v210, frame.get(), *settings, row, uyvy.empty() ? NULL : &uyvy[0]);
+    }
 }
 
-void 
-DLCapture::YuvToRgbChunk(BYTE *yuv, shared_ptr<DLFrame> rgb, unsigned int offset, unsigned int chunk_size)
+// Converts one row of YUV (as wide as the frame) into row of the frame. uyvy
+// is scratch space for v210 rows that need rounding to 8 bits first, or for
+// the 16-bit UYVY that 16-bit and tone mapped RGB are made from.
+void
+DLCapture::ConvertRow(const BYTE *src, bool is_v210, DLFrame *frame, const Settings &settings, long row, BYTE *uyvy)
 {
-    // convert 4 YUV macropixels to 6 RGB pixels
-	unsigned int i, j;
-    unsigned int boundry = offset + chunk_size;
-    unsigned char y, u, v;
-    
-    for(i=offset, j=(offset/4)*6; i<boundry; i+=4, j+=6){
-        y = yuv[i+1];
-        u = yuv[i];
-        v = yuv[i+2];
-
-        rgb->pixels[j]   = red[y][v];
-        rgb->pixels[j+1] = green[y][u][v];
-        rgb->pixels[j+2] = blue[y][u];
-
-        y = yuv[i+3];
-
-        rgb->pixels[j+3] = red[y][v];       
-        rgb->pixels[j+4] = green[y][u][v];
-        rgb->pixels[j+5] = blue[y][u];
-    }
-
-    /*
-    // fixed point math implementation - superceded by the lookup table method
-	unsigned int i, j;
-    unsigned int boundry = offset + chunk_size;
-	int yy, uu, vv, ug_plus_vg, ub, vr;
-	int r,g,b;
-    for(i=offset, j=(offset/4)*6; i<boundry; i+=4, j+=6){
-		yy = yuv[i+1] << 8;
-		uu = yuv[i] - 128;
-		vv = yuv[i+2] - 128;
-		ug_plus_vg = uu * 88 + vv * 183;
-		ub = uu * 454;
-		vr = vv * 359;
-		r = (yy + vr) >> 8;
-		g = (yy - ug_plus_vg) >> 8;
-		b = (yy + ub) >> 8;
-		rgb->pixels[j]   = r < 0 ? 0 : (r > 255 ? 255 : (unsigned char)r);
-		rgb->pixels[j+1] = g < 0 ? 0 : (g > 255 ? 255 : (unsigned char)g);
-		rgb->pixels[j+2] = b < 0 ? 0 : (b > 255 ? 255 : (unsigned char)b);
-		yy = yuv[i+3] << 8;
-		r = (yy + vr) >> 8;
-		g = (yy - ug_plus_vg) >> 8;
-		b = (yy + ub) >> 8;
-		rgb->pixels[j+3] = r < 0 ? 0 : (r > 255 ? 255 : (unsigned char)r);
-		rgb->pixels[j+4] = g < 0 ? 0 : (g > 255 ? 255 : (unsigned char)g);
-		rgb->pixels[j+5] = b < 0 ? 0 : (b > 255 ? 255 : (unsigned char)b);
-    }
-    */
-}
-
-// clamp values between 0 and 255
-inline BYTE
-DLCapture::Clamp(int value)
-{
-    if(value > 255) return 255;
-    if(value < 0)   return 0;
-    return value;
-}
-
-// tables are done for all possible values 0 - 255 of yuv
-// rather than just "legal" values of yuv.
-// two dimensional arrays for red &  blue, three dimensions for green
+    DLFrame::ColorSpace out   = frame->getNativeType();
+    long                width = frame->width;
+    BYTE               *dst   = frame->pixels + row * frame->getRowBytes();
+
+    switch(out) {
+        case DLFrame::DL_RGB:
+        case DLFrame::DL_RGBA:
+        case DLFrame::DL_BGRA:
+            if(settings.toneMap) {
+                if(is_v210)
+                    settings.v210ToUyvy16(src, uyvy, width);
+                else
+                    DLConvert::UyvyToUyvy16(src, uyvy, width);
+                settings.toneMapRow(*settings.toneMap, uyvy, dst, width);
+                if(settings.lut3D)
+                    settings.applyLut3D(*settings.lut3D, dst, width);
+                break;
+            }
+            if(is_v210) {
+                settings.v210ToUyvy(src, uyvy, width);
+                src = uyvy;
+            }
+            if(settings.tables)
+                DLConvert::UyvyToRgb_Lut(*settings.tables, src, dst, width, RgbLayout(out), settings.chroma);
+            else
+                settings.uyvyToRgb(src, dst, width);
+            if(settings.lut3D)
+                settings.applyLut3D(*settings.lut3D, dst, width);
+            break;
+
+        case DLFrame::DL_RGB32F:
+        case DLFrame::DL_RGB16F:
+        case DLFrame::DL_RGB32F_PLANAR:
+        case DLFrame::DL_RGB16F_PLANAR:
+        {
+            if(is_v210) {
+                settings.v210ToUyvy(src, uyvy, width);
+                src = uyvy;
+            }
+
+            BYTE *planes[3] = { NULL, NULL, NULL };
+            for(int plane=0; plane<frame->getPlaneCount(); plane++)
+                planes[plane] = frame->getPlane(plane) + row * frame->getPlaneRowBytes(plane);
+
+            // always fixed point, the lookup tables only make bytes
+            settings.uyvyToFloat(src, planes, settings.normalization, width);
+            break;
+        }
+
+        case DLFrame::DL_GRAYSCALE:
+            if(is_v210)
+                settings.v210ToGray(src, dst, width);
+            else
+                settings.uyvyToGray(src, dst, width);
+            break;
+
+        case DLFrame::DL_YUV16:
+            if(is_v210)
+                settings.v210ToUyvy16(src, dst, width);
+            else
+                DLConvert::UyvyToUyvy16(src, dst, width);
+            break;
+
+        case DLFrame::DL_GRAY16:
+            if(is_v210)
+                settings.v210ToGray16(src, dst, width);
+            else
+                DLConvert::UyvyToGray16(src, dst, width);
+            break;
+
+        case DLFrame::DL_RGB16:
+            // 8-bit input gets widened so there is only the one kernel
+            if(is_v210)
+                settings.v210ToUyvy16(src, uyvy, width);
+            else
+                DLConvert::UyvyToUyvy16(src, uyvy, width);
+            settings.uyvy16ToRgb16(uyvy, dst, width);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Chroma is decimated vertically by averaging each pair of rows, which puts
+// the 4:2:0 chroma samples halfway between the two luma rows (MPEG-1 / JPEG
+// siting). An odd last row gets paired with itself.
 void
-DLCapture::CreateLookupTables(void){
-
-    int yy, uu, vv, ug_plus_vg, ub, vr, val;
-
-    // Red
-    for (int y = 0; y < 256; y++) {
-        for (int v = 0; v < 256; v++) {
-            yy         = y << 8;
-            vv         = v - 128;
-            vr         = vv * 359;
-            val        = (yy + vr) >>  8;
-            red[y][v]  = Clamp(val);
+DLCapture::ConvertChunk420(Region src, shared_ptr<DLFrame> frame, SettingsPtr settings, long firstRow, long numRows)
+{
+    bool               is_v210 = (src.format == bmdFormat10BitYUV);
+    std::vector<BYTE>  uyvy0, uyvy1;
+
+    if(is_v210) {
+        uyvy0.resize(DLFrame::packedRowBytes(DLFrame::DL_YUV16, src.width) / 2);
+        uyvy1.resize(uyvy0.size());
+    }
+
+    for(long row=firstRow; row<firstRow+numRows; row+=2) {
+        long        next = min(row + 1, src.height - 1);
+        const BYTE *src0 = src.bytes + row * src.rowBytes;
+        const BYTE *src1 = src.bytes + next * src.rowBytes;
+
+        if(is_v210) {
+            settings->v210ToUyvy(src0, &uyvy0[0], src.width);
+            settings->v210ToUyvy(src1, &uyvy1[0], src.width);
+            src0 = &uyvy0[0];
+            src1 = &uyvy1[0];
         }
+
+        ConvertRows420(src0, src1, frame.get(), *settings, row, next);
     }
+}
+
+// a pair of UYVY rows (as wide as the frame) into rows row and next of a 4:2:0 frame
+void
+DLCapture::ConvertRows420(const BYTE *src0, const BYTE *src1, DLFrame *frame, const Settings &settings, long row, long next)
+{
+    BYTE *luma    = frame->getPlane(0);
+    BYTE *chroma0 = frame->getPlane(1);
+    BYTE *chroma1 = frame->getPlane(2);     // NULL for NV12
+
+    settings.uyvyTo420(src0, src1,
+                       luma + row * frame->getPlaneRowBytes(0),
+                       luma + next * frame->getPlaneRowBytes(0),
+                       chroma0 + (row / 2) * frame->getPlaneRowBytes(1),
+                       chroma1 ? chroma1 + (row / 2) * frame->getPlaneRowBytes(2) : NULL,
+                       frame->width);
+}
+
+// Scaling down in YUV means only the output pixels get converted. Everything
+// but the 16-bit formats and tone mapping (which would lose their precision)
+// can be made this way, as long as a box isn't so tall that it overflows the
+// 16-bit row sums.
+bool
+DLCapture::CanScaleInYuv(const Region &src, const Settings &settings, long width, long height)
+{
+    if(src.format != bmdFormat8BitYUV && src.format != bmdFormat10BitYUV)
+        return false;
+    if(settings.colorspace == DLFrame::DL_YUV16 ||
+       settings.colorspace == DLFrame::DL_RGB16 ||
+       settings.colorspace == DLFrame::DL_GRAY16 ||
+       settings.toneMap)
+        return false;
+    if(width <= 0 || height <= 0 || width > src.width || height > src.height)
+        return false;
+
+    return (src.height + height - 1) / height <= DLConvert::MAX_BOX_ROWS;
+}
 
-    // Blue
-    for (int y = 0; y < 256; y++) {
-        for (int u = 0; u < 256; u++) {
-            yy          = y << 8;
-            uu          = u - 128;
-            ub          = uu * 454;
-            val         = (yy + ub) >> 8;
-            blue[y][u]  = Clamp(val);
+shared_ptr<DLFrame>
+DLCapture::ConvertScaled(const Region &src, SettingsPtr settings, long width, long height)
+{
+    shared_ptr<DLFrame> frame = NewFrame(width,
+                                         height,
+                                         DLFrame::packedRowBytes(settings->colorspace, width),
+                                         settings->colorspace);
+
+    // the box edges across a row are the same for every row of the frame
+    shared_ptr<DLConvert::BoxColumns> columns(new DLConvert::BoxColumns());
+    DLConvert::CreateBoxColumns(*columns, src.width, width);
+
+    // same deal as Convert, but the bands are output rows, each made from
+    // several input rows
+    ConvertBands(height,
+                 src.rowBytes * src.height / height + frame->getRowBytes(),
+                 bind(&DLCapture::ConvertScaledChunk, this, src, columns, frame, settings, _1, _2));
+
+    return frame;
+}
+
+void
+DLCapture::ConvertScaledChunk(Region src, shared_ptr<const DLConvert::BoxColumns> columns, shared_ptr<DLFrame> frame,
+                              SettingsPtr settings, long firstRow, long numRows)
+{
+    DLFrame::ColorSpace             out       = frame->getNativeType();
+    bool                            is_420    = (out == DLFrame::DL_NV12 || out == DLFrame::DL_I420);
+    long                            src_bytes = DLFrame::packedRowBytes(DLFrame::DL_YUV16, src.width) / 2;
+    long                            dst_bytes = DLFrame::packedRowBytes(DLFrame::DL_YUV16, frame->width) / 2;
+    std::vector<unsigned short>     sums(src_bytes);
+    std::vector<BYTE>               uyvy(src_bytes);    // v210 rows rounded to 8 bits
+    std::vector<BYTE>               scaled0(dst_bytes), scaled1(dst_bytes);
+
+    for(long row=firstRow; row<firstRow+numRows; row+=(is_420 ? 2 : 1)) {
+        ScaleRow(src, *settings, *columns, row, frame->height, &sums[0], &uyvy[0], &scaled0[0]);
+
+        if(is_420) {
+            long next = min(row + 1, frame->height - 1);
+            ScaleRow(src, *settings, *columns, next, frame->height, &sums[0], &uyvy[0], &scaled1[0]);
+            ConvertRows420(&scaled0[0], &scaled1[0], frame.get(), *settings, row, next);
+        } else {
+            ConvertRow(&scaled0[0], false, frame.get(), *settings, row, NULL);
         }
     }
+}
 
-    // Green
-    for (int y = 0; y < 256; y++) {
-        for (int u = 0; u < 256; u++) {
-            for (int v = 0; v < 256; v++) {
-                yy              = y << 8;
-                uu              = u - 128;
-                vv              = v - 128;
-                ug_plus_vg      = uu * 88 + vv * 183;
-                val             = (yy - ug_plus_vg) >> 8;
-                green[y][u][v]  = Clamp(val);
-            }
+// box filters the source rows under output row row down to a row of UYVY as wide as columns says
+void
+DLCapture::ScaleRow(const Region &src, const Settings &settings, const DLConvert::BoxColumns &columns, long row, long dstHeight,
+                    unsigned short *sums, BYTE *uyvy, BYTE *scaled)
+{
+    bool is_v210   = (src.format == bmdFormat10BitYUV);
+    long src_bytes = DLFrame::packedRowBytes(DLFrame::DL_YUV16, src.width) / 2;
+    long first     = row * src.height / dstHeight;
+    long last      = (row + 1) * src.height / dstHeight;
+
+    memset(sums, 0, src_bytes * sizeof(unsigned short));
+
+    for(long y=first; y<last; y++) {
+        const BYTE *line = src.bytes + y * src.rowBytes;
+        if(is_v210) {
+            settings.v210ToUyvy(line, uyvy, src.width);
+            line = uyvy;
         }
+        settings.accumulateRow(line, sums, src_bytes);
     }
+
+    settings.boxDownscale(columns, sums, last - first, scaled);
 }
 
 shared_ptr<DLFrame>
 DLCapture::Resize(shared_ptr<DLFrame> src, int targetWidth, int targetHeight)
 {
     // check if we need to resize or not
-    if(src->height == targetHeight || src->width == targetWidth){
+    if(src->height == targetHeight && src->width == targetWidth){
         return src;
     }
 
-    // wrap in a OpenCV matrix
-    CvMat src_mat;
-    cvInitMatHeader(&src_mat, src->height, src->width, src->getOpenCVType(), src->pixels);
+    // OpenCV would average U and V samples into each other and can't do
+    // math on half floats. PostProcess hands these out unscaled.
+    DLFrame::ColorSpace colorspace = src->getNativeType();
+    if(colorspace == DLFrame::DL_YUV16 ||
+       colorspace == DLFrame::DL_RGB16F ||
+       colorspace == DLFrame::DL_RGB16F_PLANAR){
+        return src;
+    }
 
-    long row_bytes = (src->getNativeType() == DLFrame::DL_RGB) ? targetWidth*3 : targetWidth;
     // allocate space for the return image
-    shared_ptr<DLFrame> resized(new DLFrame(targetWidth, targetHeight, row_bytes, src->getNativeType()));
+    long row_bytes = DLFrame::packedRowBytes(colorspace, targetWidth);
+    shared_ptr<DLFrame> resized = NewFrame(targetWidth, targetHeight, row_bytes, colorspace);
+
+    // Planes get resized one at a time. 4:2:0 chroma is half the width
+    // (and height, which the planes already know), NV12's as Cb Cr pairs.
+    bool is_420 = (colorspace == DLFrame::DL_NV12 || colorspace == DLFrame::DL_I420);
+    for(int plane=0; plane<src->getPlaneCount(); plane++) {
+        int  type       = src->getOpenCVType();
+        long src_width  = src->width;
+        long dest_width = resized->width;
+        if(is_420 && plane > 0) {
+            src_width  = (src_width + 1) / 2;
+            dest_width = (dest_width + 1) / 2;
+            if(colorspace == DLFrame::DL_NV12)
+                type = CV_8UC2;
+        }
 
-    // wrap return image in a OpenCV matrix
-    CvMat dest_mat;
-    cvInitMatHeader(&dest_mat, resized->height, resized->width, src->getOpenCVType(), resized->pixels);
+        // wrap in OpenCV matrices
+        CvMat src_mat, dest_mat;
+        cvInitMatHeader(&src_mat, src->getPlaneHeight(plane), src_width, type,
+                        src->getPlane(plane), src->getPlaneRowBytes(plane));
+        cvInitMatHeader(&dest_mat, resized->getPlaneHeight(plane), dest_width, type,
+                        resized->getPlane(plane), resized->getPlaneRowBytes(plane));
 
-    // resize
-    cvResize(&src_mat, &dest_mat, CV_INTER_AREA);
+        // resize
+        cvResize(&src_mat, &dest_mat, CV_INTER_AREA);
+    }
 
     return resized;
- 
 }
 
 HRESULT STDMETHODCALLTYPE
@@ -433,23 +1425,24 @@ DLCapture::VideoInputFrameArrived(IDeckLinkVideoInputFrame* pArrivedFrame, IDeck
         mutex::scoped_lock l(mFramerateMutex);
         mFramerateTimestamps.push_back(ofGetElapsedTimef());
     }
-    mFrameCount++;
-
-    // precompute some junk
-    if(mDimensionsInitialized == false) {
-        InitialiseDimensions(pArrivedFrame);
+    long sequence = mFrameCount++;
+
+    // Keep the driver's thread free: take a reference and leave the
+    // conversion to RunPipeline. If the stage has fallen behind, the oldest
+    // waiting frame goes instead of this one so the latency doesn't grow,
+    // and its card buffer is handed straight back.
+    PendingFrame pending;
+    pending.frame    = pArrivedFrame;
+    pending.sequence = sequence;
+    pArrivedFrame->AddRef();
+    {
+        mutex::scoped_lock l(mPipelineMutex);
+        if(mPending.size() >= mPipelineDepth)
+            DropOldestPending();
+        mPending.push_back(pending);
+        mPipelinePeak = max(mPipelinePeak, (unsigned int)mPending.size());
     }
-    
-    // don't post process this frame if we're overwhelming the preview buffer
-//    if(10 > mFrames.size()){
-        // increase the refcount since we don't know when the thread will execute
-        pArrivedFrame->AddRef();
-        // push it to the thread pool for background processing
-        //capture_workers.schedule(bind(&DLCapture::PostProcess, this, pArrivedFrame));  
-		PostProcess(pArrivedFrame);
-	//} else {
-	//	cout << "Dropped frame" << endl;
-	//}
+    mPipelineReady.notify_all();
 
 	return S_OK;
 }
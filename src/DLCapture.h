@@ -22,10 +22,16 @@
 
 #pragma once
 
+#include <deque>
+#include <map>
+#include <string>
 #include "boost/circular_buffer.hpp"
+#include "boost/function.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread.hpp"
 #include "boost/threadpool.hpp"
 #include "DeckLinkAPI_h.h"
+#include "DLConvert.h"
 #include "DLFrame.h"
 #include "DLFrameQueue.hpp"
 
@@ -40,13 +46,41 @@ public:
     float                               getFrameRate(void);
     long                                getFrameCount(void);
     bool                                getFrame(boost::shared_ptr<DLFrame> &frame);
-    void                                setSize(int width, int height);
-    unsigned int                        getWidth(void);
+    bool                                waitForFrame(boost::shared_ptr<DLFrame> &frame, unsigned int timeoutMs); // getFrame, waiting up to timeoutMs for one
+    bool                                setSize(int width, int height);           // 0x0 to follow the crop or capture, false for a size the colorspace can't be scaled to
+    void                                setModeSize(int width, int height);       // capture size the display mode promises
+    unsigned int                        getWidth(void);                           // of the frames being handed out
     unsigned int                        getHeight(void);
     unsigned int                        getCaptureWidth(void);
     unsigned int                        getCaptureHeight(void);
     unsigned int                        getThreadpoolSize(void);
     void                                setThreadpoolSize(unsigned int size);
+    unsigned int                        getPipelineDepth(void);
+    void                                setPipelineDepth(unsigned int depth);     // captured frames that can wait for conversion
+    long                                getDroppedFrameCount(void);               // frames thrown away because the pipeline was full
+    unsigned int                        getPipelinePeak(void);                    // most frames that have been waiting at once
+    unsigned int                        getFramesInFlight(void);
+    void                                setFramesInFlight(unsigned int frames);   // frames converted at the same time, they still come out in order
+    DWORD_PTR                           getCpuAffinity(void);
+    void                                setCpuAffinity(DWORD_PTR mask);           // CPUs the conversion threads run on, 0 for any
+    int                                 getNumaNode(void);
+    bool                                setNumaNode(int node);                    // conversion threads and frames on a NUMA node, -1 for anywhere
+    DLConvert::Method                   getConversionMethod(void);
+    void                                setConversionMethod(DLConvert::Method method);
+    DLConvert::Colorimetry              getColorimetry(void);
+    void                                setColorimetry(const DLConvert::Colorimetry &colorimetry);
+    DLConvert::ChromaUpsampling         getChromaUpsampling(void);
+    void                                setChromaUpsampling(DLConvert::ChromaUpsampling chroma); // for the 8-bit RGB frame types
+    DLFrame::ColorSpace                 getColorspace(void);
+    bool                                setColorspace(DLFrame::ColorSpace colorspace);  // output frame type, false if unsupported
+    DLConvert::Normalization            getNormalization(void);
+    void                                setNormalization(const DLConvert::Normalization &normalization); // mean/scale for the float frame types
+    void                                getCrop(int &x, int &y, int &width, int &height);
+    void                                setCrop(int x, int y, int width, int height);   // only convert part of the capture, 0 size for all of it
+    bool                                loadLut3D(const std::string &path);             // .cube grading LUT for the 8-bit RGB frames, false if it can't be read
+    void                                clearLut3D(void);
+    void                                setToneMapping(const DLConvert::ToneMapping &mapping);  // decode PQ/HLG YUV to SDR BT.709 for the 8-bit RGB frame types
+    void                                clearToneMapping(void);
     
     // callback interfaces
     virtual ULONG STDMETHODCALLTYPE     AddRef(void);
@@ -60,14 +94,82 @@ public:
     
 
 private:
-    BYTE                                Clamp(int value);
-    void                                InitialiseDimensions(IDeckLinkVideoInputFrame* pArrivedFrame);
-    void                                PostProcess(IDeckLinkVideoInputFrame* pArrivedFrame);
+    // Conversion settings. A new copy gets made whenever a setting changes and
+    // each frame holds on to the copy it started with, so the workers never
+    // see a half-applied change.
+    struct Settings {
+        DLConvert::Method                           method;
+        DLConvert::Colorimetry                      colorimetry;
+        DLConvert::ChromaUpsampling                 chroma;
+        DLFrame::ColorSpace                         colorspace; // what we hand out for YUV input
+        DLConvert::Normalization                    normalization;
+        long                                        cropX;      // rectangle of the capture to convert,
+        long                                        cropY;      // no crop when cropWidth is 0
+        long                                        cropWidth;
+        long                                        cropHeight;
+        DLConvert::RowFn                            uyvyToRgb;  // fixed point kernel for the colorimetry
+        DLConvert::RowFn                            uyvyToGray;
+        DLConvert::RowFn                            v210ToUyvy;
+        DLConvert::RowFn                            v210ToUyvy16;
+        DLConvert::RowFn                            v210ToGray;
+        DLConvert::RowFn                            v210ToGray16;
+        DLConvert::RowFn                            uyvy16ToRgb16; // for the colorimetry
+        DLConvert::RowFn                            argbToBgra;
+        DLConvert::RowFn                            r210ToRgb;  // ranges from the colorimetry, layout from the colorspace
+        DLConvert::RowFn                            r210ToRgb16;
+        DLConvert::AccumulateFn                     accumulateRow;
+        DLConvert::BoxDownscaleFn                   boxDownscale;
+        DLConvert::RowPairFn                        uyvyTo420;  // NV12 or I420, whichever colorspace asks for
+        DLConvert::FloatRowFn                       uyvyToFloat; // format and planes picked by colorspace
+        DLConvert::Lut3DFn                          applyLut3D; // for the colorspace's layout
+        DLConvert::Lut3DFn                          bgraLut3D;  // for RGB input, which always comes out BGRA
+        boost::shared_ptr<const DLConvert::Lut3D>   lut3D;      // grading, none when empty
+        DLConvert::ToneMapFn                        toneMapRow; // for the colorspace's layout
+        boost::shared_ptr<const DLConvert::ToneMapTables> toneMap; // HDR -> SDR for the 8-bit RGB frames, none when empty
+        boost::shared_ptr<const DLConvert::LookupTables> tables; // only for the lookup table method, shared by every capture
+    };
+    typedef boost::shared_ptr<const Settings> SettingsPtr;
+
+    // an arrived frame waiting for the conversion stage
+    struct PendingFrame {
+        IDeckLinkVideoInputFrame                   *frame;      // holds a reference
+        long                                        sequence;   // capture order
+    };
+
+    // The part of a captured frame that gets converted, the whole thing
+    // unless there's a crop.
+    struct Region {
+        BYTE                                       *bytes;      // top left pixel
+        long                                        width;
+        long                                        height;
+        long                                        rowBytes;   // same as the capture's
+        BMDPixelFormat                              format;     // 8-bit UYVY, v210, ... of the frame it's in
+    };
+
+    SettingsPtr                         GetSettings(void);
+    void                                ApplySettings(Settings settings);
+    Region                              CropRegion(IDeckLinkVideoInputFrame* pArrivedFrame, const Settings &settings);
+    long                                BandRows(long numRows, long bytesPerRow);
+    void                                ConvertBands(long numRows, long bytesPerRow, const boost::function<void(long, long)> &chunk);
+    DLFrame::ColorSpace                 OutputColorspace(BMDPixelFormat format, const Settings &settings);
+    void                                RunPipeline(unsigned int index);
+    void                                PostProcess(IDeckLinkVideoInputFrame* pArrivedFrame, long sequence);
+    void                                Deliver(long sequence, boost::shared_ptr<DLFrame> frame);
+    void                                DropOldestPending(void);
+    boost::shared_ptr<DLFrame>          NewFrame(long width, long height, long rowBytes, DLFrame::ColorSpace colorspace);
     boost::shared_ptr<DLFrame>          Resize(boost::shared_ptr<DLFrame> src, int targetWidth, int targetHeight);
-    boost::shared_ptr<DLFrame>          YuvToGrayscale(IDeckLinkVideoInputFrame* pArrivedFrame);
-    boost::shared_ptr<DLFrame>          YuvToRgb(IDeckLinkVideoInputFrame* pArrivedFrame);
-    void                                YuvToRgbChunk(BYTE *yuv, boost::shared_ptr<DLFrame> rgb, unsigned int offset, unsigned int chunk_size);
-    void                                CreateLookupTables(void);
+    boost::shared_ptr<DLFrame>          Wrap(IDeckLinkVideoInputFrame* pArrivedFrame, const Region &src, DLFrame::ColorSpace colorspace);
+    boost::shared_ptr<DLFrame>          Convert(const Region &src, SettingsPtr settings);
+    void                                ConvertChunk(Region src, boost::shared_ptr<DLFrame> frame, SettingsPtr settings, long firstRow, long numRows);
+    void                                ConvertChunk420(Region src, boost::shared_ptr<DLFrame> frame, SettingsPtr settings, long firstRow, long numRows);
+    void                                ConvertRow(const BYTE *src, bool is_v210, DLFrame *frame, const Settings &settings, long row, BYTE *uyvy);
+    void                                ConvertRows420(const BYTE *src0, const BYTE *src1, DLFrame *frame, const Settings &settings, long row, long next);
+    bool                                CanScaleInYuv(const Region &src, const Settings &settings, long width, long height);
+    boost::shared_ptr<DLFrame>          ConvertScaled(const Region &src, SettingsPtr settings, long width, long height);
+    void                                ConvertScaledChunk(Region src, boost::shared_ptr<const DLConvert::BoxColumns> columns, boost::shared_ptr<DLFrame> frame,
+                                                           SettingsPtr settings, long firstRow, long numRows);
+    void                                ScaleRow(const Region &src, const Settings &settings, const DLConvert::BoxColumns &columns, long row, long dstHeight,
+                                                 unsigned short *sums, BYTE *uyvy, BYTE *scaled);
     
     DLFrameQueue                        fifo;                   // producer/consumer queue to hold captured frames
     boost::circular_buffer<float>       mFramerateTimestamps;   // buffer to calculate current framerate
@@ -76,24 +178,48 @@ private:
     unsigned int                        mRefCount;
 
     long                                mFrameCount;            // number of frames we've captured
-    long                                mCaptureWidth;          // width of the raw captured frame
-    long                                mCaptureHeight;         // height of the raw captured frame
-	long                                mCaptureRowBytes;
-    long                                mCaptureTotalBytes;     // 
-    long                                mGrayscaleTotalBytes;
-    long                                mRgbRowBytes;
-    unsigned int                        mWidth;                 // width after any resizing
-    unsigned int                        mHeight;                // height after any resizing
+    // The conversion only uses the Region it's given and the size asked
+    // for; the rest are just for the getters
+    long                                mCaptureWidth;          // width of the latest raw captured frame
+    long                                mCaptureHeight;         // height of the latest raw captured frame
+    unsigned int                        mWidth;                 // size setSize() asked for, only it writes these.
+    unsigned int                        mHeight;                // 0 to follow the crop or the capture
+    long                                mFrameWidth;            // size of the last frame handed out, 0 before
+    long                                mFrameHeight;           // the first one
+    boost::mutex                        mDimensionsMutex;       // protects the above
     
-    bool                                mDimensionsInitialized;
     unsigned int                        mFramerateNumFrames;
     float                               mFramerateElapsedTime;
     
-    BYTE                                red[256][256];
-    BYTE                                blue[256][256];
-    BYTE                                green[256][256][256];
+    DLConvert::Isa                      mIsa;                   // best instruction set this CPU supports
+    SettingsPtr                         mSettings;              // current conversion settings
+    boost::mutex                        mSettingsMutex;         // protects mSettings
     
     boost::threadpool::pool             conversion_workers;
-    long                                mConversionChunkSize;
-    long                                mConversionChunkSizeLeftover;
+
+    DWORD_PTR                           mAffinity;              // for the stage threads and the workers, 0 for any CPU
+    int                                 mNumaNode;              // where frames get allocated, -1 for anywhere
+    boost::mutex                        mPlacementMutex;        // protects mAffinity and mNumaNode
+
+    // hand-off between the driver's callback and the conversion stage
+    std::deque<PendingFrame>            mPending;               // arrived frames, oldest first
+    unsigned int                        mPipelineDepth;         // most frames mPending holds before dropping
+    unsigned int                        mPipelinePeak;
+    long                                mDroppedFrames;
+    unsigned int                        mFramesInFlight;        // stage threads allowed to take frames
+    bool                                mPipelineStop;
+    boost::mutex                        mPipelineMutex;         // protects everything above
+    boost::condition_variable           mPipelineReady;         // signalled when a frame arrives, on a resize or on shutdown
+    boost::thread_group                 mPipelineThreads;       // run PostProcess, one per frame in flight
+
+    // Finished frames waiting for an earlier one, so fifo sees them in
+    // capture order. An empty frame marks a sequence number that was dropped.
+    std::map<long, boost::shared_ptr<DLFrame> > mReorder;
+    long                                mNextSequence;          // the next frame fifo gets
+    float                               mReorderStall;          // when the head of mReorder started waiting, < 0 if it isn't
+    long                                mLateFrames;            // finished after they'd been given up on
+    boost::mutex                        mReorderMutex;          // protects the above and fifo's producer side,
+                                                                // taken after mPipelineMutex when both are
+    boost::mutex                        mFrameReadyMutex;       // taken after mReorderMutex when both are
+    boost::condition_variable           mFrameReady;            // signalled when fifo gets a frame
 };
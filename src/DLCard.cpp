@@ -44,7 +44,11 @@ DLCard::DLCard(IDeckLink* deckLink)
 	deckLink->AddRef();
 
     // we're not running yet.. hopefully
-    m_bRunning = false;
+    m_pLifecycle.reset(new Lifecycle);
+    m_pLifecycle->state = CAPTURE_IDLE;
+
+    // pick the colorimetry from the display mode until told otherwise
+    m_bColorimetryOverride = false;
 
     // Obtain the input and output interfaces
 	if (m_pDeckLink->QueryInterface(IID_IDeckLinkInput, (void**)&m_pInputCard) != S_OK)
@@ -440,7 +444,7 @@ bool DLCard::isVideoModeSupported(BMDDisplayMode displayMode, BMDPixelFormat pix
 
 bool DLCard::setDisplayMode(BMDDisplayMode displayMode)
 {
-    if (m_bRunning) {
+    if (state() != CAPTURE_IDLE) {
         ofLog(OF_LOG_ERROR, "setDisplayMode - can't change settings while running");
         return false;
     }
@@ -458,7 +462,7 @@ bool DLCard::setDisplayMode(BMDDisplayMode displayMode)
 
 bool DLCard::setPixelFormat(BMDPixelFormat pixelFormat)
 {
-    if (m_bRunning) {
+    if (state() != CAPTURE_IDLE) {
         ofLog(OF_LOG_ERROR, "setPixelFormat - can't change settings while running");
         return false;
     }
@@ -476,8 +480,21 @@ bool DLCard::setPixelFormat(BMDPixelFormat pixelFormat)
 
 bool DLCard::setColorspace(BMDImageType imageType)
 {
-    ofLog(OF_LOG_NOTICE, "setColorspace - not implemented yet");
-	return true;
+    switch(imageType) {
+        case BMD_IMAGE_GRAYSCALE:
+            return m_pDelegate->setColorspace(DLFrame::DL_GRAYSCALE);
+        case BMD_IMAGE_COLOR:
+            return m_pDelegate->setColorspace(DLFrame::DL_RGB);
+    }
+
+    ofLog(OF_LOG_ERROR, "setColorspace - unknown image type");
+	return false;
+}
+
+void DLCard::setColorimetry(const DLConvert::Colorimetry &colorimetry)
+{
+    m_bColorimetryOverride = true;
+    m_pDelegate->setColorimetry(colorimetry);
 }
 
 // TODO: this is not very DRY, it's sorta duplicating isVideoModeSupported.
@@ -523,29 +540,50 @@ bool DLCard::getDisplayModeParams(long &modeWidth, long &modeHeight)
     return (result == S_OK) ? true : false;
 }
 
-// TODO: change this return value?
+// Starts capture and waits until the card is streaming (or has failed to).
+// Safe to call from any thread, and again after close().
 bool DLCard::initGrabber(void)
 {
-    if (m_bRunning) {
-        ofLog(OF_LOG_ERROR, "initGrabber - can't change settings while running");
-        return false;
+    {
+        boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+        if (m_pLifecycle->state != CAPTURE_IDLE) {
+            ofLog(OF_LOG_ERROR, "initGrabber - can't change settings while running");
+            return false;
+        }
+        // claim the card before anything else can
+        m_pLifecycle->state = CAPTURE_STARTING;
     }
 
     long modeWidth, modeHeight;
     
     if(!getDisplayModeParams(modeWidth, modeHeight)){
         ofLog(OF_LOG_ERROR, "initGrabber - video input mode not supported (bad pixel format or display mode");
+        setState(CAPTURE_IDLE);
         return false;
     }    
 
-    // set the callback's display size
-    m_pDelegate->setSize(modeWidth, modeHeight);
+    // set the callback's capture size. Frames follow it (or the crop)
+    // unless the app has asked for a size of its own.
+    m_pDelegate->setModeSize(modeWidth, modeHeight);
+
+    // SD modes are BT.601, HD and 2k modes are BT.709. The card always hands
+    // us YUV at video levels, we hand out full range RGB.
+    if(!m_bColorimetryOverride) {
+        DLConvert::Matrix matrix = (modeHeight < 720) ? DLConvert::MATRIX_BT601 : DLConvert::MATRIX_BT709;
+        m_pDelegate->setColorimetry(DLConvert::Colorimetry(matrix, DLConvert::RANGE_LIMITED, DLConvert::RANGE_FULL));
+    }
 
     boost::thread pp(boost::bind(&DLCard::runThreadedCapture, this));
 
-    return true;
+    boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+    while (m_pLifecycle->state == CAPTURE_STARTING)
+        m_pLifecycle->changed.wait(l);
+    return m_pLifecycle->state == CAPTURE_RUNNING;
 }
 
+// Owns the card's input from start to stop. Frames arrive on the driver's
+// threads, so once the streams are going this just sleeps until close()
+// asks it to stop.
 void DLCard::runThreadedCapture(void)
 {
 	HRESULT result;
@@ -559,6 +597,7 @@ void DLCard::runThreadedCapture(void)
     result = m_pInputCard->EnableVideoInput(m_tDisplayMode, m_tPixelFormat, 0);
     if (result != S_OK) {
         cout << "EnableVideoInput failed with result " << result << endl;
+        setState(CAPTURE_IDLE);
         return;
     }
 		
@@ -566,23 +605,59 @@ void DLCard::runThreadedCapture(void)
     result = m_pInputCard->StartStreams();
     if (result != S_OK) {
         cout << "Input StartStreams failed with result " << result << endl;
+        m_pInputCard->DisableVideoInput();
+        setState(CAPTURE_IDLE);
         return;
     }
     
-    m_bRunning = TRUE;
+    setState(CAPTURE_RUNNING);
+
+    {
+        boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+        while (m_pLifecycle->state != CAPTURE_STOPPING)
+            m_pLifecycle->changed.wait(l);
+    }
+
+	m_pInputCard->StopStreams();
+	//m_pOutputCard->DisableVideoOutput();
+	m_pInputCard->DisableVideoInput();
+
+    setState(CAPTURE_IDLE);
+}
+
+void DLCard::setState(CaptureState state)
+{
+    boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+    m_pLifecycle->state = state;
+    m_pLifecycle->changed.notify_all();
+}
 
-    while(m_bRunning) { /* loop */ }
+DLCard::CaptureState DLCard::state(void)
+{
+    boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+    return m_pLifecycle->state;
 }
 
 bool DLCard::running(void)
 {
-    return m_bRunning;
+    return state() == CAPTURE_RUNNING;
 }
 
+// Safe to call from any thread and more than once; a close that finds
+// another one already stopping the card just waits for it.
 void DLCard::close()
 {
-	m_bRunning = FALSE;
-	m_pInputCard->StopStreams();
-	//m_pOutputCard->DisableVideoOutput();
-	m_pInputCard->DisableVideoInput();
+    boost::mutex::scoped_lock l(m_pLifecycle->mutex);
+
+    // let a start that's under way finish first
+    while (m_pLifecycle->state == CAPTURE_STARTING)
+        m_pLifecycle->changed.wait(l);
+
+    if (m_pLifecycle->state == CAPTURE_RUNNING) {
+        m_pLifecycle->state = CAPTURE_STOPPING;
+        m_pLifecycle->changed.notify_all();
+    }
+
+    while (m_pLifecycle->state != CAPTURE_IDLE)
+        m_pLifecycle->changed.wait(l);
 }
@@ -24,6 +24,8 @@
 #include <cstring>
 #include <vector>
 
+#include "boost/shared_ptr.hpp"
+#include "boost/thread.hpp"
 #include "DeckLinkAPI_h.h"
 #include "DLCapture.h"
 
@@ -67,34 +69,55 @@ public:
     BMD_IMAGE_COLOR
   } BMDImageType;
 
+  // idle -> starting -> running -> stopping -> idle, or starting -> idle
+  // if the card won't start
+  enum CaptureState {
+    CAPTURE_IDLE,
+    CAPTURE_STARTING,
+    CAPTURE_RUNNING,
+    CAPTURE_STOPPING
+  };
+
   DLCard() {};
   DLCard(IDeckLink* deckLink);
   ~DLCard();
 
-  bool initGrabber(void);                                                            // start up decklink capture
+  bool initGrabber(void);                                                            // start up decklink capture, false if it didn't start
   bool setDisplayMode(BMDDisplayMode displayMode);                                   // set the hardware display mode
   bool setPixelFormat(BMDPixelFormat pixelFormat);                                   // set the hardware pixel format
   bool setColorspace(BMDImageType imageType);                                        // set the image color space conversion
+  void setColorimetry(const DLConvert::Colorimetry &colorimetry);                    // override the YUV matrix/ranges picked from the display mode
   bool getDisplayModeParams(long &modeWidth, long &modeHeight);                      // get the hardware width/height
   bool isVideoModeSupported(BMDDisplayMode displayMode, BMDPixelFormat pixelFormat); // query the hardware for mode and format support
-  void close(void);                                                                  // shut down decklink capture
+  void close(void);                                                                  // shut down decklink capture, returns once it's stopped
   void print_name(void);
   void print_attributes(void);
   void print_output_modes(void);
   void print_capabilities(void);
   bool running(void);                                                                // whether capture is running or not
+  CaptureState state(void);
 
   DLCapture*     m_pDelegate;                                                        // the capture callback delegate
 
 private:
+  // The capture state and what waits on it. DLCards get copied into
+  // ofxBlackmagic's vector, so the copies share it.
+  struct Lifecycle {
+    boost::mutex              mutex;
+    boost::condition_variable changed;                                               // signalled on every state change
+    CaptureState              state;
+  };
+
   void runThreadedCapture(void);
+  void setState(CaptureState state);
 
   // List of known pixel formats and their matching display names
   static const BMDPixelFormat   gKnownPixelFormats[];
   static const char *           gKnownPixelFormatNames[];
 
   IDeckLink*        m_pDeckLink;
-  bool              m_bRunning;
+  boost::shared_ptr<Lifecycle> m_pLifecycle;
+  bool              m_bColorimetryOverride;                                          // user picked the colorimetry, don't guess it from the mode
   IDeckLinkInput*   m_pInputCard;
   BMDDisplayMode    m_tDisplayMode;
   BMDPixelFormat    m_tPixelFormat;
@@ -0,0 +1,3009 @@
+// Copyright (c) 2011, James Hughes
+// All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "DLConvert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#elif defined(__GNUC__) && defined(DL_HAVE_SSSE3)
+  #include <cpuid.h>
+#endif
+
+#ifdef DL_HAVE_SSSE3
+  #include <tmmintrin.h>
+#endif
+#ifdef DL_HAVE_AVX2
+  #include <immintrin.h>
+#endif
+
+// gcc and clang only emit instructions for the ISA a function was compiled for,
+// so the SIMD kernels are tagged individually instead of building the whole
+// file with -mavx2. MSVC doesn't need (or understand) this.
+#if defined(__GNUC__)
+  #define DL_TARGET(isa) __attribute__((target(isa)))
+#else
+  #define DL_TARGET(isa)
+#endif
+
+// packs a (U, V) coefficient pair into the 32-bit layout pmaddwd expects
+#define DL_COEF_PAIR(u, v)  ((int)(((unsigned int)(v) << 16) | ((unsigned int)(u) & 0xffff)))
+
+namespace DLConvert
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// CPU detection
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef DL_HAVE_SSSE3
+static void
+Cpuid(int leaf, int regs[4])
+{
+#if defined(_MSC_VER) && (_MSC_VER >= 1600)
+    __cpuidex(regs, leaf, 0);
+#elif defined(_MSC_VER)
+    __cpuid(regs, leaf);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, 0, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+
+#ifdef DL_HAVE_AVX2
+// the OS has to save the YMM registers on a context switch for us to use them
+static bool
+OsSavesYmm(void)
+{
+#if defined(_MSC_VER)
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+    return (xcr0 & 0x6) == 0x6;
+}
+#endif
+#endif
+
+Isa
+DetectIsa(void)
+{
+    Isa isa = ISA_SCALAR;
+
+#ifdef DL_HAVE_SSSE3
+    int regs[4];
+    Cpuid(0, regs);
+    int max_leaf = regs[0];
+
+    if(max_leaf < 1)
+        return isa;
+
+    Cpuid(1, regs);
+    if(regs[2] & (1 << 9))
+        isa = ISA_SSSE3;
+
+#ifdef DL_HAVE_AVX2
+    // the AVX2 kernels also use F16C for half floats. Every AVX2 part has it,
+    // but check anyway
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx     = (regs[2] & (1 << 28)) != 0;
+    bool f16c    = (regs[2] & (1 << 29)) != 0;
+    if(max_leaf >= 7 && osxsave && avx && f16c && OsSavesYmm()) {
+        Cpuid(7, regs);
+        if(regs[1] & (1 << 5))
+            isa = ISA_AVX2;
+    }
+#endif
+#endif
+
+    return isa;
+}
+
+const char*
+IsaName(Isa isa)
+{
+    switch(isa) {
+        case ISA_SCALAR: return "scalar";
+        case ISA_SSSE3:  return "SSSE3";
+        case ISA_AVX2:   return "AVX2";
+    }
+    return "unknown";
+}
+
+const char*
+MethodName(Method method)
+{
+    switch(method) {
+        case METHOD_FIXED_POINT:  return "fixed point";
+        case METHOD_LOOKUP_TABLE: return "lookup table";
+    }
+    return "unknown";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Coefficients
+////////////////////////////////////////////////////////////////////////////////
+
+// Chroma coefficients for full range signals, scaled by 256:
+//   R = Y + RV*(V-128)
+//   G = Y - GU*(U-128) - GV*(V-128)
+//   B = Y + BU*(U-128)
+// The *13 versions are scaled by 8192 for the 10-bit kernels.
+struct Bt601 { enum { RV = 359, GU = 88, GV = 183, BU = 454,                    // Kr = 0.299,  Kb = 0.114
+                      RV13 = 11485, GU13 = 2819, GV13 = 5850, BU13 = 14516 }; };
+struct Bt709 { enum { RV = 403, GU = 48, GV = 120, BU = 475,                    // Kr = 0.2126, Kb = 0.0722
+                      RV13 = 12901, GU13 = 1535, GV13 = 3835, BU13 = 15201 }; };
+
+// Scale = Num/Den takes a signal in this range to full range, Den/Num goes
+// the other way
+struct FullRange    { enum { Offset = 0,  YNum = 1,   YDen = 1,   CNum = 1,   CDen = 1   }; };
+struct LimitedRange { enum { Offset = 16, YNum = 255, YDen = 219, CNum = 255, CDen = 224 }; };
+
+// Everything folded together at compile time, still scaled by 256.
+// Each output channel is computed as
+//
+//   clamp(luma(Y) + ((C * chroma) >> 8))
+//   luma(Y) = (((Y - YOffset) * YK + 128) >> 8) + OutOffset
+//
+// For BT.601 full range in and out this is exactly the original lookup table
+// math: YK is 256, so the luma term is just Y.
+template<class M, class In, class Out>
+struct Coefficients
+{
+    typedef M   Matrix;
+    typedef In  InRange;
+    typedef Out OutRange;
+
+    enum {
+        YOffset   = In::Offset,
+        OutOffset = Out::Offset,
+        YK        = (256  * In::YNum * Out::YDen + (In::YDen * Out::YNum) / 2) / (In::YDen * Out::YNum),
+        RV        = (M::RV * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        GU        = (M::GU * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        GV        = (M::GV * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        BU        = (M::BU * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        Identity  = (YK == 256 && YOffset == 0 && OutOffset == 0)   // luma passes straight through
+    };
+};
+
+// The same folding for 10-bit YUV to 10-bit RGB, scaled by 8192 instead so
+// the products of 10-bit samples keep their precision and still fit pmaddwd.
+// The offsets go into Bias along with the rounding:
+//
+//   clamp((Y * YK + C * chroma + Bias) >> 13)      0 - 1023
+template<class C>
+struct Coefficients10
+{
+    typedef typename C::Matrix   M;
+    typedef typename C::InRange  In;
+    typedef typename C::OutRange Out;
+
+    enum {
+        YK        = (8192   * In::YNum * Out::YDen + (In::YDen * Out::YNum) / 2) / (In::YDen * Out::YNum),
+        RV        = (M::RV13 * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        GU        = (M::GU13 * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        GV        = (M::GV13 * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        BU        = (M::BU13 * In::CNum * Out::YDen + (In::CDen * Out::YNum) / 2) / (In::CDen * Out::YNum),
+        Bias      = Out::Offset * 4 * 8192 - In::Offset * 4 * YK + 4096
+    };
+};
+
+// 10-bit RGB to 8-bit RGB, converting between ranges the same way as luma.
+// K is scaled by 2^15 to suit pmulhrsw:
+//
+//   out = clamp((((V - InOffset) * K + 2^14) >> 15) + OutOffset)
+//
+// When the ranges match this is just the rounded V / 4 of To8Bit.
+template<class In, class Out>
+struct RgbLevels
+{
+    enum {
+        InOffset  = In::Offset * 4,
+        OutOffset = Out::Offset,
+        K         = (32768 * In::YNum * Out::YDen + (4 * In::YDen * Out::YNum) / 2) / (4 * In::YDen * Out::YNum)
+    };
+};
+
+// Byte offsets of each channel for the output layouts. Alpha is only written
+// for the 4 byte layouts.
+struct PackedRgb { enum { Bytes = 3, R = 0, G = 1, B = 2, A = 0 }; };
+struct PackedRgba { enum { Bytes = 4, R = 0, G = 1, B = 2, A = 3 }; };
+struct PackedBgra { enum { Bytes = 4, R = 2, G = 1, B = 0, A = 3 }; };
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar
+////////////////////////////////////////////////////////////////////////////////
+
+static inline unsigned char
+Clamp(int value)
+{
+    if(value > 255) return 255;
+    if(value < 0)   return 0;
+    return (unsigned char)value;
+}
+
+template<class C>
+static inline int
+Luma(int y)
+{
+    return ((((y - C::YOffset) * C::YK) + 128) >> 8) + C::OutOffset;
+}
+
+template<class C>
+static void
+CreateLookupTables(LookupTables &lut)
+{
+    // Red
+    for (int y = 0; y < 256; y++)
+        for (int v = 0; v < 256; v++)
+            lut.red[y][v] = Clamp(Luma<C>(y) + (((v - 128) * C::RV) >> 8));
+
+    // Blue
+    for (int y = 0; y < 256; y++)
+        for (int u = 0; u < 256; u++)
+            lut.blue[y][u] = Clamp(Luma<C>(y) + (((u - 128) * C::BU) >> 8));
+
+    // Green. The chroma term doesn't depend on Y, so it's worked out once
+    // per (U, V) and the 16.7M entries are just an add and a clamp each.
+    std::vector<int> term(256 * 256);
+    for (int u = 0; u < 256; u++)
+        for (int v = 0; v < 256; v++)
+            term[u * 256 + v] = -((u - 128) * C::GU + (v - 128) * C::GV) >> 8;
+
+    for (int y = 0; y < 256; y++) {
+        const int      luma  = Luma<C>(y);
+        unsigned char *green = &lut.green[y][0][0];
+        for (int uv = 0; uv < 256 * 256; uv++)
+            green[uv] = Clamp(luma + term[uv]);
+    }
+}
+
+template<class L>
+static inline void
+StorePixel(unsigned char *dst, unsigned char r, unsigned char g, unsigned char b)
+{
+    dst[L::R] = r;
+    dst[L::G] = g;
+    dst[L::B] = b;
+    if(L::Bytes == 4)
+        dst[L::A] = 255;
+}
+
+template<class C>
+static inline void
+ChromaTerms(int u, int v, int &r, int &g, int &b)
+{
+    int uu = u - 128;
+    int vv = v - 128;
+    r = (vv * C::RV) >> 8;
+    g = -(uu * C::GU + vv * C::GV) >> 8;
+    b = (uu * C::BU) >> 8;
+}
+
+// rounded average of two chroma terms, the term halfway between them
+static inline int
+MidTerm(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+// fixed point math, identical to the lookup tables. Also used to mop up the
+// pixels at the end of a row that don't fill a whole vector.
+//
+// Linear chroma upsampling gives the odd pixel of each macropixel the
+// average of its own and the next macropixel's chroma terms, which is where a
+// co-sited sample halfway between the two would be. Each macropixel's terms
+// are worked out once and carried on to the next one, so the average is all
+// it costs. The last macropixel of the row has nothing to average with and
+// keeps its own.
+template<class C, class L, bool Linear>
+static void
+UyvyToRgb_Scalar(const unsigned char *uyvy, unsigned char *rgb, long numPixels)
+{
+    int r, g, b, y;
+    int odd_r, odd_g, odd_b;
+
+    if(Linear && numPixels > 0)
+        ChromaTerms<C>(uyvy[0], uyvy[2], r, g, b);
+
+    for(long i=0; i<numPixels; i+=2, uyvy+=4, rgb+=2*L::Bytes) {
+        // linear chroma already has these from the last macropixel
+        if(!Linear)
+            ChromaTerms<C>(uyvy[0], uyvy[2], r, g, b);
+
+        y = Luma<C>(uyvy[1]);
+        StorePixel<L>(rgb, Clamp(y + r), Clamp(y + g), Clamp(y + b));
+
+        // odd sized runs only use the first half of the last macropixel
+        if(i + 1 == numPixels)
+            break;
+
+        odd_r = r;
+        odd_g = g;
+        odd_b = b;
+        if(Linear && i + 2 < numPixels) {
+            ChromaTerms<C>(uyvy[4], uyvy[6], r, g, b);
+            odd_r = MidTerm(odd_r, r);
+            odd_g = MidTerm(odd_g, g);
+            odd_b = MidTerm(odd_b, b);
+        }
+
+        y = Luma<C>(uyvy[3]);
+        StorePixel<L>(rgb + L::Bytes, Clamp(y + odd_r), Clamp(y + odd_g), Clamp(y + odd_b));
+    }
+}
+
+// The tables hold finished channels rather than chroma terms, so linear
+// chroma looks up the average of the two macropixels' U and V instead. That
+// can land a step away from the fixed point kernels.
+template<class L, bool Linear>
+static void
+UyvyToRgb_Lut(const LookupTables &lut, const unsigned char *uyvy, unsigned char *rgb, long numPixels)
+{
+    unsigned char y, u, v;
+
+    for(long i=0; i<numPixels; i+=2, uyvy+=4, rgb+=2*L::Bytes) {
+        y = uyvy[1];
+        u = uyvy[0];
+        v = uyvy[2];
+
+        StorePixel<L>(rgb, lut.red[y][v], lut.green[y][u][v], lut.blue[y][u]);
+
+        if(i + 1 == numPixels)
+            break;
+
+        if(Linear && i + 2 < numPixels) {
+            u = (unsigned char)((uyvy[0] + uyvy[4] + 1) >> 1);
+            v = (unsigned char)((uyvy[2] + uyvy[6] + 1) >> 1);
+        }
+
+        y = uyvy[3];
+
+        StorePixel<L>(rgb + L::Bytes, lut.red[y][v], lut.green[y][u][v], lut.blue[y][u]);
+    }
+}
+
+template<class L>
+static void
+UyvyToRgb_Lut(const LookupTables &lut, const unsigned char *uyvy, unsigned char *rgb, long numPixels, ChromaUpsampling chroma)
+{
+    if(chroma == CHROMA_LINEAR)
+        UyvyToRgb_Lut<L, true>(lut, uyvy, rgb, numPixels);
+    else
+        UyvyToRgb_Lut<L, false>(lut, uyvy, rgb, numPixels);
+}
+
+void
+UyvyToRgb_Lut(const LookupTables &lut, const unsigned char *uyvy, unsigned char *rgb, long numPixels, Layout layout, ChromaUpsampling chroma)
+{
+    switch(layout) {
+        case LAYOUT_RGBA: UyvyToRgb_Lut<PackedRgba>(lut, uyvy, rgb, numPixels, chroma); break;
+        case LAYOUT_BGRA: UyvyToRgb_Lut<PackedBgra>(lut, uyvy, rgb, numPixels, chroma); break;
+        default:          UyvyToRgb_Lut<PackedRgb>(lut, uyvy, rgb, numPixels, chroma);  break;
+    }
+}
+
+static void
+UyvyToGray_Scalar(const unsigned char *uyvy, unsigned char *gray, long numPixels)
+{
+    // simple YUV -> Grayscale, just throw away the U and V channels
+    for(long i=0; i<numPixels; i++)
+        gray[i] = uyvy[(i*2)+1];
+}
+
+void
+UyvyToUyvy16(const unsigned char *uyvy, unsigned char *uyvy16, long numPixels)
+{
+    unsigned short *out        = (unsigned short*)uyvy16;
+    long            numSamples = ((numPixels + 1) / 2) * 4;
+
+    for(long i=0; i<numSamples; i++)
+        out[i] = (unsigned short)(uyvy[i] << 8);
+}
+
+void
+UyvyToGray16(const unsigned char *uyvy, unsigned char *gray16, long numPixels)
+{
+    unsigned short *out = (unsigned short*)gray16;
+
+    for(long i=0; i<numPixels; i++)
+        out[i] = (unsigned short)(uyvy[(i*2)+1] << 8);
+}
+
+// a 2^13 scaled 10-bit value, clamped and put in the top of 16 bits
+static inline unsigned short
+Deep(int sum)
+{
+    int value = sum >> 13;
+    if(value > 1023) value = 1023;
+    if(value < 0)    value = 0;
+    return (unsigned short)(value << 6);
+}
+
+template<class C>
+static void
+Uyvy16ToRgb16_Scalar(const unsigned char *uyvy16, unsigned char *rgb16, long numPixels)
+{
+    typedef Coefficients10<C> K;
+    const unsigned short *in  = (const unsigned short*)uyvy16;
+    unsigned short       *out = (unsigned short*)rgb16;
+
+    for(long i=0; i<numPixels; i+=2, in+=4) {
+        int u  = (in[0] >> 6) - 512;
+        int v  = (in[2] >> 6) - 512;
+        int cr = v * K::RV;
+        int cg = -u * K::GU - v * K::GV;
+        int cb = u * K::BU;
+
+        for(int k=0; k<2 && i+k<numPixels; k++, out+=3) {
+            int y = (in[1 + k*2] >> 6) * K::YK + K::Bias;
+            out[0] = Deep(y + cr);
+            out[1] = Deep(y + cg);
+            out[2] = Deep(y + cb);
+        }
+    }
+}
+
+static inline unsigned int
+ReadLE32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// pulls the 12 samples of a v210 group out in UYVY order
+static inline void
+UnpackV210Group(const unsigned char *v210, unsigned int samples[12])
+{
+    for(int w=0; w<4; w++) {
+        unsigned int word = ReadLE32(v210 + w*4);
+        samples[w*3]      = word & 0x3ff;
+        samples[w*3 + 1]  = (word >> 10) & 0x3ff;
+        samples[w*3 + 2]  = (word >> 20) & 0x3ff;
+    }
+}
+
+// 10-bit -> 8-bit, rounded
+static inline unsigned char
+To8Bit(unsigned int sample)
+{
+    sample = (sample + 2) >> 2;
+    return (sample > 255) ? 255 : (unsigned char)sample;
+}
+
+// The scalar v210 kernels always unpack whole groups. That's safe to read
+// because rows are padded out to 48 pixels, we just don't write the samples
+// past the end of the run.
+static void
+V210ToUyvy_Scalar(const unsigned char *v210, unsigned char *uyvy, long numPixels)
+{
+    long         numSamples = ((numPixels + 1) / 2) * 4;
+    unsigned int samples[12];
+
+    for(long i=0; i<numSamples; i+=12, v210+=16) {
+        UnpackV210Group(v210, samples);
+        for(long k=0; k<12 && i+k<numSamples; k++)
+            uyvy[i+k] = To8Bit(samples[k]);
+    }
+}
+
+static void
+V210ToUyvy16_Scalar(const unsigned char *v210, unsigned char *uyvy16, long numPixels)
+{
+    unsigned short *out        = (unsigned short*)uyvy16;
+    long            numSamples = ((numPixels + 1) / 2) * 4;
+    unsigned int    samples[12];
+
+    for(long i=0; i<numSamples; i+=12, v210+=16) {
+        UnpackV210Group(v210, samples);
+        for(long k=0; k<12 && i+k<numSamples; k++)
+            out[i+k] = (unsigned short)(samples[k] << 6);
+    }
+}
+
+static void
+V210ToGray_Scalar(const unsigned char *v210, unsigned char *gray, long numPixels)
+{
+    unsigned int samples[12];
+
+    for(long i=0; i<numPixels; i+=6, v210+=16) {
+        UnpackV210Group(v210, samples);
+        for(long k=0; k<6 && i+k<numPixels; k++)
+            gray[i+k] = To8Bit(samples[k*2 + 1]);
+    }
+}
+
+static void
+V210ToGray16_Scalar(const unsigned char *v210, unsigned char *gray16, long numPixels)
+{
+    unsigned short *out = (unsigned short*)gray16;
+    unsigned int    samples[12];
+
+    for(long i=0; i<numPixels; i+=6, v210+=16) {
+        UnpackV210Group(v210, samples);
+        for(long k=0; k<6 && i+k<numPixels; k++)
+            out[i+k] = (unsigned short)(samples[k*2 + 1] << 6);
+    }
+}
+
+static inline unsigned int
+ReadBE32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+template<class V>
+static inline unsigned char
+R210Level(unsigned int sample)
+{
+    int v = (int)(sample & 0x3ff) - V::InOffset;
+    return Clamp(((v * V::K + 16384) >> 15) + V::OutOffset);
+}
+
+template<class V, class L>
+static void
+R210ToRgb_Scalar(const unsigned char *r210, unsigned char *rgb, long numPixels)
+{
+    for(long i=0; i<numPixels; i++, r210+=4, rgb+=L::Bytes) {
+        unsigned int word = ReadBE32(r210);
+        StorePixel<L>(rgb, R210Level<V>(word >> 20), R210Level<V>(word >> 10), R210Level<V>(word));
+    }
+}
+
+static void
+R210ToRgb16_Scalar(const unsigned char *r210, unsigned char *rgb16, long numPixels)
+{
+    unsigned short *out = (unsigned short*)rgb16;
+
+    for(long i=0; i<numPixels; i++, r210+=4, out+=3) {
+        unsigned int word = ReadBE32(r210);
+        out[0] = (unsigned short)(((word >> 20) & 0x3ff) << 6);
+        out[1] = (unsigned short)(((word >> 10) & 0x3ff) << 6);
+        out[2] = (unsigned short)((word & 0x3ff) << 6);
+    }
+}
+
+static void
+ArgbToBgra_Scalar(const unsigned char *argb, unsigned char *bgra, long numPixels)
+{
+    for(long i=0; i<numPixels; i++, argb+=4, bgra+=4) {
+        unsigned char a = argb[0], r = argb[1], g = argb[2], b = argb[3];
+        bgra[0] = b;
+        bgra[1] = g;
+        bgra[2] = r;
+        bgra[3] = a;
+    }
+}
+
+unsigned short
+FloatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, 4);
+
+    unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+    unsigned int   abs  = bits & 0x7fffffff;
+
+    // NaN stays NaN, infinity and anything too big for a half is infinity
+    if(abs > 0x7f800000)
+        return sign | 0x7e00;
+    if(abs >= 0x47800000)
+        return sign | 0x7c00;
+
+    // too small for even a denormal half
+    if(abs < 0x33000000)
+        return sign;
+
+    unsigned int half, rest, halfway;
+    if(abs < 0x38800000) {
+        // denormal half, put the implicit 1 back and shift the mantissa down
+        unsigned int shift    = 126 - (abs >> 23);
+        unsigned int mantissa = (abs & 0x7fffff) | 0x800000;
+        half    = mantissa >> shift;
+        rest    = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        // rebias the exponent from 127 to 15, a carry out of the mantissa
+        // bumps the exponent (up to infinity) which is what we want
+        half    = (abs - 0x38000000) >> 13;
+        rest    = abs & 0x1fff;
+        halfway = 0x1000;
+    }
+
+    if(rest > halfway || (rest == halfway && (half & 1)))
+        half++;
+
+    return sign | (unsigned short)half;
+}
+
+static inline void
+PutFloat(float *dst, float value)           { *dst = value; }
+static inline void
+PutFloat(unsigned short *dst, float value)  { *dst = FloatToHalf(value); }
+
+// T is float or unsigned short (half)
+template<class C, class T, bool Planar>
+static void
+UyvyToFloat_Scalar(const unsigned char *uyvy, unsigned char *const dst[3], const Normalization &norm, long numPixels)
+{
+    T             *out[3] = { (T*)dst[0], (T*)dst[1], (T*)dst[2] };
+    float          bias[3];
+    unsigned char  rgb[6];
+
+    for(int c=0; c<3; c++)
+        bias[c] = -norm.mean[c] * norm.scale[c];
+
+    for(long i=0; i<numPixels; i+=2, uyvy+=4) {
+        long n = (i + 1 == numPixels) ? 1 : 2;
+        UyvyToRgb_Scalar<C, PackedRgb, false>(uyvy, rgb, n);
+
+        for(long k=0; k<n; k++) {
+            for(int c=0; c<3; c++) {
+                float value = rgb[k*3 + c] * norm.scale[c] + bias[c];
+                if(Planar)
+                    PutFloat(out[c] + i + k, value);
+                else
+                    PutFloat(out[0] + (i + k)*3 + c, value);
+            }
+        }
+    }
+}
+
+// where the scalar code picks up after the vector loop is done with i pixels
+template<class T, bool Planar>
+static inline void
+AdvanceFloatRow(unsigned char *const dst[3], long i, unsigned char *out[3])
+{
+    if(Planar) {
+        for(int c=0; c<3; c++)
+            out[c] = dst[c] + i*sizeof(T);
+    } else {
+        out[0] = dst[0] + i*3*sizeof(T);
+        out[1] = out[2] = NULL;
+    }
+}
+
+// Interleaved picks NV12 (one Cb Cr plane) over I420 (separate Cb and Cr planes)
+template<bool Interleaved>
+static void
+UyvyTo420_Scalar(const unsigned char *uyvy0, const unsigned char *uyvy1,
+                 unsigned char *y0, unsigned char *y1,
+                 unsigned char *u, unsigned char *v, long numPixels)
+{
+    for(long i=0; i<numPixels; i+=2, uyvy0+=4, uyvy1+=4) {
+        unsigned char cb = (unsigned char)((uyvy0[0] + uyvy1[0] + 1) >> 1);
+        unsigned char cr = (unsigned char)((uyvy0[2] + uyvy1[2] + 1) >> 1);
+
+        if(Interleaved) {
+            *u++ = cb;
+            *u++ = cr;
+        } else {
+            *u++ = cb;
+            *v++ = cr;
+        }
+
+        y0[i] = uyvy0[1];
+        y1[i] = uyvy1[1];
+
+        if(i + 1 == numPixels)
+            break;
+
+        y0[i+1] = uyvy0[3];
+        y1[i+1] = uyvy1[3];
+    }
+}
+
+static void
+AccumulateRow_Scalar(const unsigned char *src, unsigned short *sums, long numBytes)
+{
+    for(long i=0; i<numBytes; i++)
+        sums[i] = (unsigned short)(sums[i] + src[i]);
+}
+
+// (sum + count/2) / count as a multiply and a shift. With sums of 8-bit
+// samples this is exact for every count under 256, which covers boxes up to
+// about 15:1 each way; anything wider falls back to dividing.
+struct BoxDivider {
+    unsigned int    half;
+    unsigned int    reciprocal;     // ceil(2^24 / count)
+};
+
+enum { MAX_DIVIDER_COUNT = 256 };
+
+static inline BoxDivider
+MakeBoxDivider(unsigned int count)
+{
+    BoxDivider d = { count / 2, ((1u << 24) + count - 1) / count };
+    return d;
+}
+
+static inline unsigned char
+BoxDivide(unsigned int sum, const BoxDivider &d)
+{
+    return (unsigned char)(((sum + d.half) * d.reciprocal) >> 24);
+}
+
+// The same thing in 16-bit lanes for the SIMD ratio paths: a high half
+// multiply and a shift, exact for counts under 128. Powers of two come out as
+// a plain shift.
+struct BoxDivider16 {
+    unsigned short  half;
+    unsigned short  reciprocal;
+    int             shift;
+};
+
+enum { MAX_DIVIDER16_COUNT = 128 };
+
+static inline BoxDivider16
+MakeBoxDivider16(unsigned int count)
+{
+    BoxDivider16 d = { (unsigned short)(count / 2), 0, 0 };
+
+    while((2u << d.shift) <= count)
+        d.shift++;
+    if((count & (count - 1)) == 0)
+        d.shift--;
+    d.reciprocal = (unsigned short)(((1u << (16 + d.shift)) + count - 1) / count);
+    return d;
+}
+
+// averages with the reciprocals of every box width in the row
+struct ReciprocalAverage {
+    ReciprocalAverage(long maxCount, long numRows)
+    {
+        for(long count=1; count<=maxCount; count++)
+            dividers[count] = MakeBoxDivider((unsigned int)(count * numRows));
+    }
+
+    unsigned char operator()(unsigned int sum, long count) const { return BoxDivide(sum, dividers[count]); }
+
+    BoxDivider dividers[MAX_DIVIDER_COUNT];
+};
+
+struct DivideAverage {
+    explicit DivideAverage(long numRows) : numRows(numRows) {}
+
+    unsigned char operator()(unsigned int sum, long count) const
+    {
+        unsigned int total = (unsigned int)(count * numRows);
+        return (unsigned char)((sum + total/2) / total);
+    }
+
+    long numRows;
+};
+
+// Output pixel x covers source pixels [x*srcWidth/dstWidth, (x+1)*srcWidth/dstWidth),
+// so boxes are whole source pixels and uneven ratios give slightly uneven
+// boxes. The chroma of an output macropixel averages every source macropixel
+// that either of its pixels touches.
+void
+CreateBoxColumns(BoxColumns &columns, long srcWidth, long dstWidth)
+{
+    long num_macropixels = (dstWidth + 1) / 2;
+
+    columns.srcWidth = srcWidth;
+    columns.dstWidth = dstWidth;
+    columns.maxCount = 1;
+    columns.edges.resize(dstWidth + 1);
+    columns.chroma.resize(num_macropixels * 2);
+
+    for(long x=0; x<=dstWidth; x++)
+        columns.edges[x] = x * srcWidth / dstWidth;
+
+    for(long x=0; x<dstWidth; x++)
+        columns.maxCount = std::max(columns.maxCount, columns.edges[x + 1] - columns.edges[x]);
+
+    for(long m=0; m<num_macropixels; m++) {
+        // odd widths only have half a macropixel at the end
+        long x      = m * 2;
+        long pixels = (x + 1 < dstWidth) ? 2 : 1;
+
+        columns.chroma[m * 2]     = columns.edges[x] / 2;
+        columns.chroma[m * 2 + 1] = (columns.edges[x + pixels] + 1) / 2;
+        columns.maxCount = std::max(columns.maxCount, columns.chroma[m * 2 + 1] - columns.chroma[m * 2]);
+    }
+
+    // 2:1 and 4:1 have every box the same width, so the sums line up with
+    // fixed offsets
+    columns.ratio = 0;
+    if(dstWidth % 2 == 0 && (srcWidth == dstWidth * 2 || srcWidth == dstWidth * 4))
+        columns.ratio = srcWidth / dstWidth;
+}
+
+template<class Average>
+static void
+UyvyBoxDownscale_Columns(const BoxColumns &columns, const unsigned short *sums, unsigned char *uyvy, const Average &average)
+{
+    const long *edges  = &columns.edges[0];
+    const long *chroma = &columns.chroma[0];
+
+    for(long x=0; x<columns.dstWidth; x+=2, uyvy+=4, chroma+=2) {
+        // repeat the luma of a trailing half macropixel
+        long right = std::min(x + 1, columns.dstWidth - 1);
+        unsigned int y0 = 0, y1 = 0, u = 0, v = 0;
+
+        for(long i=edges[x]; i<edges[x + 1]; i++)
+            y0 += sums[i * 2 + 1];
+        for(long i=edges[right]; i<edges[right + 1]; i++)
+            y1 += sums[i * 2 + 1];
+        for(long i=chroma[0]; i<chroma[1]; i++) {
+            u += sums[i * 4];
+            v += sums[i * 4 + 2];
+        }
+
+        uyvy[0] = average(u,  chroma[1] - chroma[0]);
+        uyvy[1] = average(y0, edges[x + 1] - edges[x]);
+        uyvy[2] = average(v,  chroma[1] - chroma[0]);
+        uyvy[3] = average(y1, edges[right + 1] - edges[right]);
+    }
+}
+
+// every output macropixel is Ratio source macropixels
+template<int Ratio>
+static void
+UyvyBoxDownscale_Ratio(const unsigned short *sums, unsigned char *uyvy, long dstWidth, const BoxDivider &d)
+{
+    for(long x=0; x<dstWidth; x+=2, sums+=Ratio*4, uyvy+=4) {
+        unsigned int y0 = 0, y1 = 0, u = 0, v = 0;
+
+        for(int i=0; i<Ratio; i++) {
+            u  += sums[i * 4];
+            v  += sums[i * 4 + 2];
+            y0 += sums[i * 2 + 1];
+            y1 += sums[Ratio * 2 + i * 2 + 1];
+        }
+
+        uyvy[0] = BoxDivide(u,  d);
+        uyvy[1] = BoxDivide(y0, d);
+        uyvy[2] = BoxDivide(v,  d);
+        uyvy[3] = BoxDivide(y1, d);
+    }
+}
+
+static void
+UyvyBoxDownscale_Scalar(const BoxColumns &columns, const unsigned short *sums, long numRows, unsigned char *uyvy)
+{
+    if(columns.maxCount * numRows >= MAX_DIVIDER_COUNT) {
+        UyvyBoxDownscale_Columns(columns, sums, uyvy, DivideAverage(numRows));
+        return;
+    }
+
+    switch(columns.ratio) {
+        case 2:
+            UyvyBoxDownscale_Ratio<2>(sums, uyvy, columns.dstWidth, MakeBoxDivider((unsigned int)(numRows * 2)));
+            break;
+        case 4:
+            UyvyBoxDownscale_Ratio<4>(sums, uyvy, columns.dstWidth, MakeBoxDivider((unsigned int)(numRows * 4)));
+            break;
+        default:
+            UyvyBoxDownscale_Columns(columns, sums, uyvy, ReciprocalAverage(columns.maxCount, numRows));
+            break;
+    }
+}
+
+// Fixed point steps through a 3D LUT. An 8-bit value lands at p/256 cells
+// along the axis; the last cell is used with a fraction of 256 for 255 so the
+// far corner of the cell is always inside the table.
+static inline int
+LutStep(int size)
+{
+    return ((size - 1) << 16) / 255;
+}
+
+static inline void
+LutCoord(int value, int step, int size, int &index, int &frac)
+{
+    int p = (value * step + 128) >> 8;
+    index = p >> 8;
+    if(index > size - 2)
+        index = size - 2;
+    frac  = p - (index << 8);
+}
+
+template<int Shift>
+static inline int
+LutBlend(const unsigned int c[4], const int w[4])
+{
+    int sum = 0;
+    for(int k=0; k<4; k++)
+        sum += w[k] * (int)((c[k] >> Shift) & 1023);
+    return (sum + 512) >> 10;
+}
+
+// Tetrahedral interpolation walks from the near corner of the cell to the
+// far one along the axis with the biggest fraction first, then the middle
+// one. Ties don't matter, the corner they'd pick gets no weight.
+template<class L>
+static void
+ApplyLut3D_Scalar(const Lut3D &lut, unsigned char *pixels, long numPixels)
+{
+    const unsigned int *entries = &lut.entries[0];
+    const int           n       = lut.size;
+    const int           step    = LutStep(n);
+    const int           sr = 1, sg = n, sb = n * n, sall = sr + sg + sb;
+
+    for(long i=0; i<numPixels; i++, pixels+=L::Bytes) {
+        int ir, fr, ig, fg, ib, fb;
+        LutCoord(pixels[L::R], step, n, ir, fr);
+        LutCoord(pixels[L::G], step, n, ig, fg);
+        LutCoord(pixels[L::B], step, n, ib, fb);
+
+        int fmax = (fr > fg) ? ((fr > fb) ? fr : fb) : ((fg > fb) ? fg : fb);
+        int fmin = (fr < fg) ? ((fr < fb) ? fr : fb) : ((fg < fb) ? fg : fb);
+        int fmid = fr + fg + fb - fmax - fmin;
+        int smax = (fr == fmax) ? sr : (fg == fmax) ? sg : sb;
+        int smin = (fb == fmin) ? sb : (fg == fmin) ? sg : sr;
+
+        const unsigned int *cell = entries + ir + ig * sg + ib * sb;
+        unsigned int c[4] = { cell[0], cell[smax], cell[sall - smin], cell[sall] };
+        int          w[4] = { 256 - fmax, fmax - fmid, fmid - fmin, fmin };
+
+        pixels[L::R] = (unsigned char)LutBlend<0>(c, w);
+        pixels[L::G] = (unsigned char)LutBlend<10>(c, w);
+        pixels[L::B] = (unsigned char)LutBlend<20>(c, w);
+    }
+}
+
+// HDR tone mapping. The YUV matrix is the same 10-bit math as
+// Uyvy16ToRgb16, but the coefficients come from the tables rather than being
+// compiled in; the table lookups cost far more than the multiplies.
+static inline int
+ToneCode(int sum)
+{
+    int value = sum >> 13;
+    if(value > TONE_EOTF_SIZE - 1) value = TONE_EOTF_SIZE - 1;
+    if(value < 0)                  value = 0;
+    return value;
+}
+
+// row k of the gamut matrix, then the OETF
+static inline unsigned char
+ToneOut(const ToneMapTables &t, const int lin[3], int k)
+{
+    int index = (t.gamut[k*3] * lin[0] + t.gamut[k*3 + 1] * lin[1] + t.gamut[k*3 + 2] * lin[2] + 32768) >> 16;
+    if(index > TONE_OETF_SIZE - 1) index = TONE_OETF_SIZE - 1;
+    if(index < 0)                  index = 0;
+    return t.oetf[index];
+}
+
+template<class L>
+static void
+Uyvy16ToneMap_Scalar(const ToneMapTables &t, const unsigned char *uyvy16, unsigned char *rgb, long numPixels)
+{
+    const unsigned short *in = (const unsigned short*)uyvy16;
+    int                   lin[3];
+
+    for(long i=0; i<numPixels; i++, rgb+=L::Bytes) {
+        const unsigned short *mp = in + (i / 2) * 4;
+
+        int y = (mp[1 + (i & 1) * 2] >> 6) * t.yk + t.bias;
+        int u = (mp[0] >> 6) - 512;
+        int v = (mp[2] >> 6) - 512;
+
+        lin[0] = t.eotf[ToneCode(y + v * t.rv)];
+        lin[1] = t.eotf[ToneCode(y - u * t.gu - v * t.gv)];
+        lin[2] = t.eotf[ToneCode(y + u * t.bu)];
+
+        StorePixel<L>(rgb, ToneOut(t, lin, 0), ToneOut(t, lin, 1), ToneOut(t, lin, 2));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SSSE3 / AVX2
+////////////////////////////////////////////////////////////////////////////////
+
+// The vector kernels load the UYVY bytes as 16-bit words, so each word holds a
+// chroma sample in the low byte and a luma sample in the high byte:
+//
+//   chroma = word & 0xff  ->  U0 V0 U1 V1 ...  (interleaved, ready for pmaddwd)
+//   luma   = word >> 8    ->  Y0 Y1 Y2 Y3 ...
+//
+// pmaddwd against (U coefficient, V coefficient) pairs gives one 32-bit chroma
+// term per macropixel, which is shifted down exactly like the scalar code so
+// the results stay bit-identical. The terms are duplicated for both pixels of
+// each macropixel, added to luma and clamped with a saturating pack.
+//
+// The luma term uses pmulhrsw, which computes (a*b + 0x4000) >> 15. With a
+// pre-shifted left by 7 that's (Y*YK + 128) >> 8, the same rounding as Luma().
+
+#ifdef DL_HAVE_SSSE3
+
+template<class C, bool Identity = (C::Identity != 0)>
+struct Luma_SSSE3
+{
+    DL_TARGET("ssse3") static inline __m128i Apply(__m128i y)
+    {
+        __m128i x = _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(C::YOffset)), 7);
+        return _mm_add_epi16(_mm_mulhrs_epi16(x, _mm_set1_epi16(C::YK)), _mm_set1_epi16(C::OutOffset));
+    }
+};
+
+template<class C>
+struct Luma_SSSE3<C, true>
+{
+    DL_TARGET("ssse3") static inline __m128i Apply(__m128i y) { return y; }
+};
+
+// interleave 16 red, green and blue bytes to 48 bytes of RGB
+DL_TARGET("ssse3") static inline void
+StoreRgb_SSSE3(unsigned char *rgb, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8( 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5);
+    const __m128i g0 = _mm_setr_epi8(-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8( 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    __m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0));
+    __m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1));
+    __m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2));
+
+    _mm_storeu_si128((__m128i*)(rgb),      out0);
+    _mm_storeu_si128((__m128i*)(rgb + 16), out1);
+    _mm_storeu_si128((__m128i*)(rgb + 32), out2);
+}
+
+// interleave 16 pixels worth of channels to 64 bytes of c0 c1 c2 alpha
+DL_TARGET("ssse3") static inline void
+Store4_SSSE3(unsigned char *dst, __m128i c0, __m128i c1, __m128i c2)
+{
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+    __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+    __m128i lo2a = _mm_unpacklo_epi8(c2, alpha);
+    __m128i hi2a = _mm_unpackhi_epi8(c2, alpha);
+
+    _mm_storeu_si128((__m128i*)(dst),      _mm_unpacklo_epi16(lo01, lo2a));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(lo01, lo2a));
+    _mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(hi01, hi2a));
+    _mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(hi01, hi2a));
+}
+
+// picks the store for a layout at compile time
+DL_TARGET("ssse3") static inline void
+StorePixels_SSSE3(PackedRgb, unsigned char *dst, __m128i r, __m128i g, __m128i b)  { StoreRgb_SSSE3(dst, r, g, b); }
+DL_TARGET("ssse3") static inline void
+StorePixels_SSSE3(PackedRgba, unsigned char *dst, __m128i r, __m128i g, __m128i b) { Store4_SSSE3(dst, r, g, b); }
+DL_TARGET("ssse3") static inline void
+StorePixels_SSSE3(PackedBgra, unsigned char *dst, __m128i r, __m128i g, __m128i b) { Store4_SSSE3(dst, b, g, r); }
+
+// 8 chroma terms (one per macropixel) from two vectors of interleaved U/V
+DL_TARGET("ssse3") static inline __m128i
+ChromaTerm_SSSE3(__m128i uv_a, __m128i uv_b, __m128i coef)
+{
+    __m128i a = _mm_srai_epi32(_mm_madd_epi16(uv_a, coef), 8);
+    __m128i b = _mm_srai_epi32(_mm_madd_epi16(uv_b, coef), 8);
+    return _mm_packs_epi32(a, b);
+}
+
+// luma + chroma term for 16 pixels, clamped to 0..255. The even pixels of
+// each macropixel get their term from even, the odd ones from odd.
+DL_TARGET("ssse3") static inline __m128i
+Channel_SSSE3(__m128i y_a, __m128i y_b, __m128i even, __m128i odd)
+{
+    __m128i lo = _mm_adds_epi16(y_a, _mm_unpacklo_epi16(even, odd));
+    __m128i hi = _mm_adds_epi16(y_b, _mm_unpackhi_epi16(even, odd));
+    return _mm_packus_epi16(lo, hi);
+}
+
+// the luma of 16 pixels of UYVY, pixels 0-7 in y_a and 8-15 in y_b
+template<class C>
+DL_TARGET("ssse3") static inline void
+DecodeLuma_SSSE3(const unsigned char *uyvy, __m128i &y_a, __m128i &y_b)
+{
+    y_a = Luma_SSSE3<C>::Apply(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy)), 8));
+    y_b = Luma_SSSE3<C>::Apply(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy + 16)), 8));
+}
+
+// the red, green and blue chroma terms of the 8 macropixels in 16 pixels of UYVY
+template<class C>
+DL_TARGET("ssse3") static inline void
+DecodeChroma_SSSE3(const unsigned char *uyvy, __m128i &r, __m128i &g, __m128i &b)
+{
+    const __m128i low_byte = _mm_set1_epi16(0x00ff);
+    const __m128i bias     = _mm_set1_epi16(128);
+    const __m128i coef_r   = _mm_set1_epi32(DL_COEF_PAIR(0, C::RV));
+    const __m128i coef_g   = _mm_set1_epi32(DL_COEF_PAIR(-C::GU, -C::GV));
+    const __m128i coef_b   = _mm_set1_epi32(DL_COEF_PAIR(C::BU, 0));
+
+    __m128i uv_a = _mm_sub_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)(uyvy)), low_byte), bias);
+    __m128i uv_b = _mm_sub_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)(uyvy + 16)), low_byte), bias);
+
+    r = ChromaTerm_SSSE3(uv_a, uv_b, coef_r);
+    g = ChromaTerm_SSSE3(uv_a, uv_b, coef_g);
+    b = ChromaTerm_SSSE3(uv_a, uv_b, coef_b);
+}
+
+// MidTerm for each macropixel's term and the one after it. next holds the
+// terms of the following 8 macropixels, only the first gets used. mulhrs by
+// a half rounds and halves the sum in one instruction.
+DL_TARGET("ssse3") static inline __m128i
+MidTerm_SSSE3(__m128i term, __m128i next)
+{
+    __m128i after = _mm_alignr_epi8(next, term, 2);
+    return _mm_mulhrs_epi16(_mm_add_epi16(term, after), _mm_set1_epi16(0x4000));
+}
+
+// 16 pixels of UYVY to 16 bytes each of red, green and blue
+template<class C>
+DL_TARGET("ssse3") static inline void
+DecodeRgb_SSSE3(const unsigned char *uyvy, __m128i &r, __m128i &g, __m128i &b)
+{
+    __m128i y_a, y_b, term_r, term_g, term_b;
+
+    DecodeLuma_SSSE3<C>(uyvy, y_a, y_b);
+    DecodeChroma_SSSE3<C>(uyvy, term_r, term_g, term_b);
+
+    r = Channel_SSSE3(y_a, y_b, term_r, term_r);
+    g = Channel_SSSE3(y_a, y_b, term_g, term_g);
+    b = Channel_SSSE3(y_a, y_b, term_b, term_b);
+}
+
+// Linear chroma works out the next 16 pixels' terms before finishing these,
+// for the odd pixel of the last macropixel, and carries them on. The vector
+// loop stops short of the last 16 pixels so those terms are always there,
+// and the scalar code finishes the row.
+template<class C, class L, bool Linear>
+DL_TARGET("ssse3") static void
+UyvyToRgb_SSSE3(const unsigned char *uyvy, unsigned char *rgb, long numPixels)
+{
+    __m128i r, g, b;
+
+    long i = 0;
+    if(Linear) {
+        __m128i y_a, y_b, term_r, term_g, term_b, next_r, next_g, next_b;
+
+        if(numPixels >= 32)
+            DecodeChroma_SSSE3<C>(uyvy, term_r, term_g, term_b);
+
+        for(; i + 32 <= numPixels; i += 16, uyvy += 32, rgb += 16*L::Bytes) {
+            DecodeLuma_SSSE3<C>(uyvy, y_a, y_b);
+            DecodeChroma_SSSE3<C>(uyvy + 32, next_r, next_g, next_b);
+
+            r = Channel_SSSE3(y_a, y_b, term_r, MidTerm_SSSE3(term_r, next_r));
+            g = Channel_SSSE3(y_a, y_b, term_g, MidTerm_SSSE3(term_g, next_g));
+            b = Channel_SSSE3(y_a, y_b, term_b, MidTerm_SSSE3(term_b, next_b));
+            StorePixels_SSSE3(L(), rgb, r, g, b);
+
+            term_r = next_r;
+            term_g = next_g;
+            term_b = next_b;
+        }
+    } else {
+        for(; i + 16 <= numPixels; i += 16, uyvy += 32, rgb += 16*L::Bytes) {
+            DecodeRgb_SSSE3<C>(uyvy, r, g, b);
+            StorePixels_SSSE3(L(), rgb, r, g, b);
+        }
+    }
+
+    UyvyToRgb_Scalar<C, L, Linear>(uyvy, rgb, numPixels - i);
+}
+
+// luma is the high byte of every 16-bit word, so a shift and a pack gives 16
+// pixels of grayscale
+DL_TARGET("ssse3") static void
+UyvyToGray_SSSE3(const unsigned char *uyvy, unsigned char *gray, long numPixels)
+{
+    long i = 0;
+    for(; i + 16 <= numPixels; i += 16, uyvy += 32, gray += 16) {
+        __m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy)), 8);
+        __m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy + 16)), 8);
+        _mm_storeu_si128((__m128i*)gray, _mm_packus_epi16(a, b));
+    }
+
+    UyvyToGray_Scalar(uyvy, gray, numPixels - i);
+}
+
+DL_TARGET("ssse3") static void
+AccumulateRow_SSSE3(const unsigned char *src, unsigned short *sums, long numBytes)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    long i = 0;
+    for(; i + 16 <= numBytes; i += 16) {
+        __m128i x  = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_loadu_si128((const __m128i*)(sums + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(sums + i + 8));
+        _mm_storeu_si128((__m128i*)(sums + i),     _mm_add_epi16(lo, _mm_unpacklo_epi8(x, zero)));
+        _mm_storeu_si128((__m128i*)(sums + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(x, zero)));
+    }
+
+    AccumulateRow_Scalar(src + i, sums + i, numBytes - i);
+}
+
+// Box sums of two neighbouring source macropixels per output macropixel, for
+// two output macropixels: U0 Y0 V0 Y1 U1 Y2 V1 Y3 becomes U0+U1 Y0+Y1 V0+V1 Y2+Y3.
+// Applied twice it gives the sums for 4:1.
+DL_TARGET("ssse3") static inline __m128i
+HalveBoxSums_SSSE3(__m128i a, __m128i b)
+{
+    const __m128i order = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 10, 11, 8, 9, 6, 7, 12, 13, 14, 15);
+
+    a = _mm_shuffle_epi8(a, order);
+    b = _mm_shuffle_epi8(b, order);
+    return _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+}
+
+// sums for the next two output macropixels
+template<int Ratio> DL_TARGET("ssse3") static inline __m128i BoxSums_SSSE3(const unsigned short *sums);
+
+template<> DL_TARGET("ssse3") inline __m128i
+BoxSums_SSSE3<2>(const unsigned short *sums)
+{
+    return HalveBoxSums_SSSE3(_mm_loadu_si128((const __m128i*)sums), _mm_loadu_si128((const __m128i*)(sums + 8)));
+}
+
+template<> DL_TARGET("ssse3") inline __m128i
+BoxSums_SSSE3<4>(const unsigned short *sums)
+{
+    return HalveBoxSums_SSSE3(BoxSums_SSSE3<2>(sums), BoxSums_SSSE3<2>(sums + 16));
+}
+
+template<int Ratio>
+DL_TARGET("ssse3") static void
+UyvyBoxDownscale_Ratio_SSSE3(const unsigned short *sums, unsigned char *uyvy, long dstWidth, long numRows)
+{
+    BoxDivider16  d          = MakeBoxDivider16((unsigned int)(numRows * Ratio));
+    const __m128i half       = _mm_set1_epi16((short)d.half);
+    const __m128i reciprocal = _mm_set1_epi16((short)d.reciprocal);
+    const __m128i shift      = _mm_cvtsi32_si128(d.shift);
+
+    long x = 0;
+    for(; x + 8 <= dstWidth; x += 8, sums += Ratio * 16, uyvy += 16) {
+        __m128i lo = _mm_srl_epi16(_mm_mulhi_epu16(_mm_add_epi16(BoxSums_SSSE3<Ratio>(sums), half), reciprocal), shift);
+        __m128i hi = _mm_srl_epi16(_mm_mulhi_epu16(_mm_add_epi16(BoxSums_SSSE3<Ratio>(sums + Ratio * 8), half), reciprocal), shift);
+        _mm_storeu_si128((__m128i*)uyvy, _mm_packus_epi16(lo, hi));
+    }
+
+    UyvyBoxDownscale_Ratio<Ratio>(sums, uyvy, dstWidth - x, MakeBoxDivider((unsigned int)(numRows * Ratio)));
+}
+
+static void
+UyvyBoxDownscale_SSSE3(const BoxColumns &columns, const unsigned short *sums, long numRows, unsigned char *uyvy)
+{
+    if(columns.ratio == 0 || columns.ratio * numRows >= MAX_DIVIDER16_COUNT) {
+        UyvyBoxDownscale_Scalar(columns, sums, numRows, uyvy);
+        return;
+    }
+
+    if(columns.ratio == 2)
+        UyvyBoxDownscale_Ratio_SSSE3<2>(sums, uyvy, columns.dstWidth, numRows);
+    else
+        UyvyBoxDownscale_Ratio_SSSE3<4>(sums, uyvy, columns.dstWidth, numRows);
+}
+
+// Splits the three 10-bit fields out of each word of a v210 group:
+//   ab = a0 a1 a2 a3 b0 b1 b2 b3   (a = bits 0-9, b = bits 10-19)
+//   cc = c0 c1 c2 c3 c0 c1 c2 c3   (c = bits 20-29)
+// as 16-bit values. In UYVY order the group is a0 b0 c0 a1 b1 c1 a2 b2 c2 a3 b3 c3.
+DL_TARGET("ssse3") static inline void
+UnpackV210_SSSE3(const unsigned char *v210, __m128i &ab, __m128i &cc)
+{
+    const __m128i mask = _mm_set1_epi32(0x3ff);
+
+    __m128i w = _mm_loadu_si128((const __m128i*)v210);
+    __m128i a = _mm_and_si128(w, mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(w, 10), mask);
+    __m128i c = _mm_and_si128(_mm_srli_epi32(w, 20), mask);
+
+    ab = _mm_packs_epi32(a, b);
+    cc = _mm_packs_epi32(c, c);
+}
+
+// rounds both halves of an unpacked group to 8 bits:
+// a0 a1 a2 a3 b0 b1 b2 b3 c0 c1 c2 c3 (c0 c1 c2 c3)
+DL_TARGET("ssse3") static inline __m128i
+V210To8Bit_SSSE3(__m128i ab, __m128i cc)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    ab = _mm_srli_epi16(_mm_add_epi16(ab, two), 2);
+    cc = _mm_srli_epi16(_mm_add_epi16(cc, two), 2);
+    return _mm_packus_epi16(ab, cc);
+}
+
+static inline void
+Store32(unsigned char *dst, int value)
+{
+    memcpy(dst, &value, 4);
+}
+
+DL_TARGET("ssse3") static void
+V210ToUyvy_SSSE3(const unsigned char *v210, unsigned char *uyvy, long numPixels)
+{
+    const __m128i order = _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    __m128i ab, cc;
+
+    long i = 0;
+    for(; i + 6 <= numPixels; i += 6, v210 += 16, uyvy += 12) {
+        UnpackV210_SSSE3(v210, ab, cc);
+        __m128i out = _mm_shuffle_epi8(V210To8Bit_SSSE3(ab, cc), order);
+
+        _mm_storel_epi64((__m128i*)uyvy, out);
+        Store32(uyvy + 8, _mm_cvtsi128_si32(_mm_srli_si128(out, 8)));
+    }
+
+    V210ToUyvy_Scalar(v210, uyvy, numPixels - i);
+}
+
+DL_TARGET("ssse3") static void
+V210ToUyvy16_SSSE3(const unsigned char *v210, unsigned char *uyvy16, long numPixels)
+{
+    // a0 b0 c0 a1 b1 c1 a2 b2 | c2 a3 b3 c3
+    const __m128i ab0 = _mm_setr_epi8( 0,  1,  8,  9, -1, -1,  2,  3, 10, 11, -1, -1,  4,  5, 12, 13);
+    const __m128i cc0 = _mm_setr_epi8(-1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1);
+    const __m128i ab1 = _mm_setr_epi8(-1, -1,  6,  7, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i cc1 = _mm_setr_epi8( 4,  5, -1, -1, -1, -1,  6,  7, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i ab, cc;
+
+    long i = 0;
+    for(; i + 6 <= numPixels; i += 6, v210 += 16, uyvy16 += 24) {
+        UnpackV210_SSSE3(v210, ab, cc);
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(ab, ab0), _mm_shuffle_epi8(cc, cc0));
+        __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(ab, ab1), _mm_shuffle_epi8(cc, cc1));
+
+        _mm_storeu_si128((__m128i*)uyvy16, _mm_slli_epi16(out0, 6));
+        _mm_storel_epi64((__m128i*)(uyvy16 + 16), _mm_slli_epi16(out1, 6));
+    }
+
+    V210ToUyvy16_Scalar(v210, uyvy16, numPixels - i);
+}
+
+DL_TARGET("ssse3") static void
+V210ToGray_SSSE3(const unsigned char *v210, unsigned char *gray, long numPixels)
+{
+    // luma is b0 a1 c1 b2 a3 c3, two groups at a time so we can store 12 bytes
+    const __m128i first  = _mm_setr_epi8(4, 1, 9, 6, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 1, 9, 6, 3, 11, -1, -1, -1, -1);
+    __m128i ab, cc;
+
+    long i = 0;
+    for(; i + 12 <= numPixels; i += 12, v210 += 32, gray += 12) {
+        UnpackV210_SSSE3(v210, ab, cc);
+        __m128i y0 = _mm_shuffle_epi8(V210To8Bit_SSSE3(ab, cc), first);
+        UnpackV210_SSSE3(v210 + 16, ab, cc);
+        __m128i y1 = _mm_shuffle_epi8(V210To8Bit_SSSE3(ab, cc), second);
+        __m128i out = _mm_or_si128(y0, y1);
+
+        _mm_storel_epi64((__m128i*)gray, out);
+        Store32(gray + 8, _mm_cvtsi128_si32(_mm_srli_si128(out, 8)));
+    }
+
+    V210ToGray_Scalar(v210, gray, numPixels - i);
+}
+
+DL_TARGET("ssse3") static void
+V210ToGray16_SSSE3(const unsigned char *v210, unsigned char *gray16, long numPixels)
+{
+    // b0 a1 c1 b2 a3 c3, as words
+    const __m128i luma_ab = _mm_setr_epi8(8, 9, 2, 3, -1, -1, 12, 13, 6, 7, -1, -1, -1, -1, -1, -1);
+    const __m128i luma_cc = _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1);
+    __m128i ab, cc;
+
+    long i = 0;
+    for(; i + 6 <= numPixels; i += 6, v210 += 16, gray16 += 12) {
+        UnpackV210_SSSE3(v210, ab, cc);
+        __m128i out = _mm_slli_epi16(_mm_or_si128(_mm_shuffle_epi8(ab, luma_ab), _mm_shuffle_epi8(cc, luma_cc)), 6);
+
+        _mm_storel_epi64((__m128i*)gray16, out);
+        Store32(gray16 + 8, _mm_cvtsi128_si32(_mm_srli_si128(out, 8)));
+    }
+
+    V210ToGray16_Scalar(v210, gray16, numPixels - i);
+}
+
+// 8 r210 pixels to R, G and B in 16-bit lanes
+DL_TARGET("ssse3") static inline void
+UnpackR210_SSSE3(const unsigned char *r210, __m128i &r, __m128i &g, __m128i &b)
+{
+    const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i mask = _mm_set1_epi32(0x3ff);
+
+    __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r210)), swap);
+    __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r210 + 16)), swap);
+
+    r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(w0, 20), mask), _mm_and_si128(_mm_srli_epi32(w1, 20), mask));
+    g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(w0, 10), mask), _mm_and_si128(_mm_srli_epi32(w1, 10), mask));
+    b = _mm_packs_epi32(_mm_and_si128(w0, mask), _mm_and_si128(w1, mask));
+}
+
+template<class V>
+DL_TARGET("ssse3") static inline __m128i
+R210Level_SSSE3(__m128i x)
+{
+    x = _mm_sub_epi16(x, _mm_set1_epi16(V::InOffset));
+    return _mm_add_epi16(_mm_mulhrs_epi16(x, _mm_set1_epi16(V::K)), _mm_set1_epi16(V::OutOffset));
+}
+
+template<class V, class L>
+DL_TARGET("ssse3") static void
+R210ToRgb_SSSE3(const unsigned char *r210, unsigned char *rgb, long numPixels)
+{
+    __m128i r0, g0, b0, r1, g1, b1;
+
+    long i = 0;
+    for(; i + 16 <= numPixels; i += 16, r210 += 64, rgb += 16*L::Bytes) {
+        UnpackR210_SSSE3(r210,      r0, g0, b0);
+        UnpackR210_SSSE3(r210 + 32, r1, g1, b1);
+        StorePixels_SSSE3(L(), rgb,
+                          _mm_packus_epi16(R210Level_SSSE3<V>(r0), R210Level_SSSE3<V>(r1)),
+                          _mm_packus_epi16(R210Level_SSSE3<V>(g0), R210Level_SSSE3<V>(g1)),
+                          _mm_packus_epi16(R210Level_SSSE3<V>(b0), R210Level_SSSE3<V>(b1)));
+    }
+
+    R210ToRgb_Scalar<V, L>(r210, rgb, numPixels - i);
+}
+
+// interleave 8 red, green and blue words to 48 bytes of 16-bit RGB
+DL_TARGET("ssse3") static inline void
+StoreRgb16_SSSE3(unsigned char *rgb16, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8( 0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1,  4,  5, -1, -1);
+    const __m128i g0 = _mm_setr_epi8(-1, -1,  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1,  4,  5);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1, -1, -1, 10, 11);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8( 4,  5, -1, -1, -1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15);
+
+    __m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0));
+    __m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1));
+    __m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2));
+
+    _mm_storeu_si128((__m128i*)(rgb16),      out0);
+    _mm_storeu_si128((__m128i*)(rgb16 + 16), out1);
+    _mm_storeu_si128((__m128i*)(rgb16 + 32), out2);
+}
+
+DL_TARGET("ssse3") static void
+R210ToRgb16_SSSE3(const unsigned char *r210, unsigned char *rgb16, long numPixels)
+{
+    __m128i r, g, b;
+
+    long i = 0;
+    for(; i + 8 <= numPixels; i += 8, r210 += 32, rgb16 += 48) {
+        UnpackR210_SSSE3(r210, r, g, b);
+        StoreRgb16_SSSE3(rgb16, _mm_slli_epi16(r, 6), _mm_slli_epi16(g, 6), _mm_slli_epi16(b, 6));
+    }
+
+    R210ToRgb16_Scalar(r210, rgb16, numPixels - i);
+}
+
+// One channel of 8 pixels: the luma terms of pixels 0-3 and 4-7 plus the
+// chroma term of their macropixels, clamped to 10 bits and put at the top.
+DL_TARGET("ssse3") static inline __m128i
+Deep_SSSE3(__m128i y_lo, __m128i y_hi, __m128i term)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top  = _mm_set1_epi16(1023);
+
+    __m128i lo = _mm_srai_epi32(_mm_add_epi32(y_lo, _mm_shuffle_epi32(term, 0x50)), 13);
+    __m128i hi = _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_shuffle_epi32(term, 0xfa)), 13);
+    __m128i x  = _mm_packs_epi32(lo, hi);
+    return _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(x, zero), top), 6);
+}
+
+// 8 pixels of UYVY16 to luma terms (Y * YK + Bias) for pixels 0-3 and 4-7 and
+// the 4 (U, V) pairs, less 512, ready for pmaddwd
+template<class K>
+DL_TARGET("ssse3") static inline void
+DecodeDeep_SSSE3(const unsigned char *uyvy16, __m128i &y_lo, __m128i &y_hi, __m128i &uv)
+{
+    const __m128i luma   = _mm_setr_epi8(2, 3, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1);
+    const __m128i chroma = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i yk     = _mm_set1_epi32(K::YK);
+    const __m128i bias   = _mm_set1_epi32(K::Bias);
+
+    __m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy16)), 6);
+    __m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(uyvy16 + 16)), 6);
+
+    y_lo = _mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(a, luma), yk), bias);
+    y_hi = _mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(b, luma), yk), bias);
+    uv   = _mm_sub_epi16(_mm_unpacklo_epi64(_mm_shuffle_epi8(a, chroma), _mm_shuffle_epi8(b, chroma)), _mm_set1_epi16(512));
+}
+
+template<class C>
+DL_TARGET("ssse3") static void
+Uyvy16ToRgb16_SSSE3(const unsigned char *uyvy16, unsigned char *rgb16, long numPixels)
+{
+    typedef Coefficients10<C> K;
+    const __m128i coef_r = _mm_set1_epi32(DL_COEF_PAIR(0, K::RV));
+    const __m128i coef_g = _mm_set1_epi32(DL_COEF_PAIR(-K::GU, -K::GV));
+    const __m128i coef_b = _mm_set1_epi32(DL_COEF_PAIR(K::BU, 0));
+    __m128i y_lo, y_hi, uv;
+
+    long i = 0;
+    for(; i + 8 <= numPixels; i += 8, uyvy16 += 32, rgb16 += 48) {
+        DecodeDeep_SSSE3<K>(uyvy16, y_lo, y_hi, uv);
+        StoreRgb16_SSSE3(rgb16,
+                         Deep_SSSE3(y_lo, y_hi, _mm_madd_epi16(uv, coef_r)),
+                         Deep_SSSE3(y_lo, y_hi, _mm_madd_epi16(uv, coef_g)),
+                         Deep_SSSE3(y_lo, y_hi, _mm_madd_epi16(uv, coef_b)));
+    }
+
+    Uyvy16ToRgb16_Scalar<C>(uyvy16, rgb16, numPixels - i);
+}
+
+DL_TARGET("ssse3") static void
+ArgbToBgra_SSSE3(const unsigned char *argb, unsigned char *bgra, long numPixels)
+{
+    const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    long i = 0;
+    for(; i + 4 <= numPixels; i += 4, argb += 16, bgra += 16)
+        _mm_storeu_si128((__m128i*)bgra, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)argb), reverse));
+
+    ArgbToBgra_Scalar(argb, bgra, numPixels - i);
+}
+
+// 16 pixels of both rows per pass. pavgb rounds the same way as the scalar code.
+template<bool Interleaved>
+DL_TARGET("ssse3") static void
+UyvyTo420_SSSE3(const unsigned char *uyvy0, const unsigned char *uyvy1,
+                unsigned char *y0, unsigned char *y1,
+                unsigned char *u, unsigned char *v, long numPixels)
+{
+    const __m128i low_byte = _mm_set1_epi16(0x00ff);
+    const __m128i split    = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+    long i = 0;
+    for(; i + 16 <= numPixels; i += 16, uyvy0 += 32, uyvy1 += 32) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(uyvy0));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(uyvy0 + 16));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(uyvy1));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(uyvy1 + 16));
+
+        _mm_storeu_si128((__m128i*)(y0 + i), _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8)));
+        _mm_storeu_si128((__m128i*)(y1 + i), _mm_packus_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8)));
+
+        // Cb0 Cr0 Cb1 Cr1 ...
+        __m128i uv = _mm_packus_epi16(_mm_and_si128(_mm_avg_epu8(a0, a1), low_byte),
+                                      _mm_and_si128(_mm_avg_epu8(b0, b1), low_byte));
+        if(Interleaved) {
+            _mm_storeu_si128((__m128i*)u, uv);
+            u += 16;
+        } else {
+            uv = _mm_shuffle_epi8(uv, split);
+            _mm_storel_epi64((__m128i*)u, uv);
+            _mm_storel_epi64((__m128i*)v, _mm_srli_si128(uv, 8));
+            u += 8;
+            v += 8;
+        }
+    }
+
+    UyvyTo420_Scalar<Interleaved>(uyvy0, uyvy1, y0 + i, y1 + i, u, v, numPixels - i);
+}
+
+// The float kernels decode a block of pixels to bytes with the same code as
+// the 8-bit kernels, park them in a small buffer that never leaves L1, and
+// convert that to float with (x * scale) + bias. Interleaved output cycles
+// through the channels, so there's a scale/bias vector for each channel the
+// first lane can land on.
+DL_TARGET("ssse3") static inline __m128
+Normalize_SSSE3(const unsigned char *bytes, __m128 scale, __m128 bias)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int           packed;
+
+    memcpy(&packed, bytes, 4);
+    __m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+    return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(x), scale), bias);
+}
+
+DL_TARGET("ssse3") static inline void
+Store4_SSSE3(float *dst, __m128 value)
+{
+    _mm_storeu_ps(dst, value);
+}
+
+DL_TARGET("ssse3") static inline void
+Store4_SSSE3(unsigned short *dst, __m128 value)
+{
+    float values[4];
+    _mm_storeu_ps(values, value);
+    for(int k=0; k<4; k++)
+        dst[k] = FloatToHalf(values[k]);
+}
+
+// lane l of pattern o gets channel (o + l) % 3 for interleaved output, every
+// lane of pattern c gets channel c for planar output
+template<bool Planar>
+DL_TARGET("ssse3") static inline void
+FloatPatterns_SSSE3(const Normalization &norm, __m128 scale[3], __m128 bias[3])
+{
+    for(int o=0; o<3; o++) {
+        float s[4], b[4];
+        for(int l=0; l<4; l++) {
+            int c = Planar ? o : (o + l) % 3;
+            s[l]  = norm.scale[c];
+            b[l]  = -norm.mean[c] * norm.scale[c];
+        }
+        scale[o] = _mm_loadu_ps(s);
+        bias[o]  = _mm_loadu_ps(b);
+    }
+}
+
+template<class C, class T, bool Planar>
+DL_TARGET("ssse3") static void
+UyvyToFloat_SSSE3(const unsigned char *uyvy, unsigned char *const dst[3], const Normalization &norm, long numPixels)
+{
+    T             *out[3] = { (T*)dst[0], (T*)dst[1], (T*)dst[2] };
+    __m128         scale[3], bias[3];
+    unsigned char  bytes[48];
+    __m128i        r, g, b;
+
+    FloatPatterns_SSSE3<Planar>(norm, scale, bias);
+
+    long i = 0;
+    for(; i + 16 <= numPixels; i += 16, uyvy += 32) {
+        DecodeRgb_SSSE3<C>(uyvy, r, g, b);
+
+        if(Planar) {
+            _mm_storeu_si128((__m128i*)(bytes),      r);
+            _mm_storeu_si128((__m128i*)(bytes + 16), g);
+            _mm_storeu_si128((__m128i*)(bytes + 32), b);
+            for(int c=0; c<3; c++)
+                for(int q=0; q<4; q++)
+                    Store4_SSSE3(out[c] + i + q*4, Normalize_SSSE3(bytes + c*16 + q*4, scale[c], bias[c]));
+        } else {
+            // vector m starts on float 4m, which is channel m % 3
+            StoreRgb_SSSE3(bytes, r, g, b);
+            for(int m=0; m<12; m++)
+                Store4_SSSE3(out[0] + i*3 + m*4, Normalize_SSSE3(bytes + m*4, scale[m % 3], bias[m % 3]));
+        }
+    }
+
+    unsigned char *rest[3];
+    AdvanceFloatRow<T, Planar>(dst, i, rest);
+    UyvyToFloat_Scalar<C, T, Planar>(uyvy, rest, norm, numPixels - i);
+}
+
+#endif // DL_HAVE_SSSE3
+
+#ifdef DL_HAVE_AVX2
+
+template<class C, bool Identity = (C::Identity != 0)>
+struct Luma_AVX2
+{
+    DL_TARGET("avx2") static inline __m256i Apply(__m256i y)
+    {
+        __m256i x = _mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(C::YOffset)), 7);
+        return _mm256_add_epi16(_mm256_mulhrs_epi16(x, _mm256_set1_epi16(C::YK)), _mm256_set1_epi16(C::OutOffset));
+    }
+};
+
+template<class C>
+struct Luma_AVX2<C, true>
+{
+    DL_TARGET("avx2") static inline __m256i Apply(__m256i y) { return y; }
+};
+
+DL_TARGET("avx2") static inline __m256i
+ChromaTerm_AVX2(__m256i uv_a, __m256i uv_b, __m256i coef)
+{
+    __m256i a = _mm256_srai_epi32(_mm256_madd_epi16(uv_a, coef), 8);
+    __m256i b = _mm256_srai_epi32(_mm256_madd_epi16(uv_b, coef), 8);
+    return _mm256_packs_epi32(a, b);
+}
+
+// 32 pixels of a channel, from luma laid out as DecodeLuma_AVX2 leaves it.
+// The unpacks and the pack work within 128-bit lanes, which that layout
+// already accounts for, so the pixels come out in order.
+DL_TARGET("avx2") static inline __m256i
+Channel_AVX2(__m256i y_a, __m256i y_b, __m256i even, __m256i odd)
+{
+    __m256i lo = _mm256_adds_epi16(y_a, _mm256_unpacklo_epi16(even, odd));
+    __m256i hi = _mm256_adds_epi16(y_b, _mm256_unpackhi_epi16(even, odd));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// interleave 32 red, green and blue bytes to 96 bytes of RGB. Same masks as
+// StoreRgb_SSSE3, applied to both lanes at once, so each lane of out0-out2
+// holds a third of that lane's 48 bytes.
+DL_TARGET("avx2") static inline void
+InterleaveRgb_AVX2(__m256i r, __m256i g, __m256i b, __m256i &out0, __m256i &out1, __m256i &out2)
+{
+    const __m256i r0 = _mm256_setr_epi8( 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5,
+                                         0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5);
+    const __m256i g0 = _mm256_setr_epi8(-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,
+                                        -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1);
+    const __m256i b0 = _mm256_setr_epi8(-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1,
+                                        -1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1);
+    const __m256i r1 = _mm256_setr_epi8(-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1,
+                                        -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1);
+    const __m256i g1 = _mm256_setr_epi8( 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10,
+                                         5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10);
+    const __m256i b1 = _mm256_setr_epi8(-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1,
+                                        -1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1);
+    const __m256i r2 = _mm256_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1,
+                                        -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m256i g2 = _mm256_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1,
+                                        -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m256i b2 = _mm256_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15,
+                                        10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    out0 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r0), _mm256_shuffle_epi8(g, g0)), _mm256_shuffle_epi8(b, b0));
+    out1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r1), _mm256_shuffle_epi8(g, g1)), _mm256_shuffle_epi8(b, b1));
+    out2 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r2), _mm256_shuffle_epi8(g, g2)), _mm256_shuffle_epi8(b, b2));
+}
+
+DL_TARGET("avx2") static inline void
+StoreRgb_AVX2(unsigned char *rgb, __m256i r, __m256i g, __m256i b)
+{
+    __m256i out0, out1, out2;
+
+    InterleaveRgb_AVX2(r, g, b, out0, out1, out2);
+    _mm256_storeu_si256((__m256i*)(rgb),      _mm256_permute2x128_si256(out0, out1, 0x20));
+    _mm256_storeu_si256((__m256i*)(rgb + 32), _mm256_permute2x128_si256(out2, out0, 0x30));
+    _mm256_storeu_si256((__m256i*)(rgb + 64), _mm256_permute2x128_si256(out1, out2, 0x31));
+}
+
+// interleave 32 pixels worth of channels to 128 bytes of c0 c1 c2 alpha. The
+// unpacks work within 128-bit lanes, so lane 0 holds pixels 0-15 and lane 1
+// pixels 16-31 until the final permutes.
+DL_TARGET("avx2") static inline void
+Interleave4_AVX2(__m256i c0, __m256i c1, __m256i c2, __m256i &p0, __m256i &p1, __m256i &p2, __m256i &p3)
+{
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    __m256i lo01 = _mm256_unpacklo_epi8(c0, c1);
+    __m256i hi01 = _mm256_unpackhi_epi8(c0, c1);
+    __m256i lo2a = _mm256_unpacklo_epi8(c2, alpha);
+    __m256i hi2a = _mm256_unpackhi_epi8(c2, alpha);
+
+    p0 = _mm256_unpacklo_epi16(lo01, lo2a);     // pixels  0-3,  16-19
+    p1 = _mm256_unpackhi_epi16(lo01, lo2a);     // pixels  4-7,  20-23
+    p2 = _mm256_unpacklo_epi16(hi01, hi2a);     // pixels  8-11, 24-27
+    p3 = _mm256_unpackhi_epi16(hi01, hi2a);     // pixels 12-15, 28-31
+}
+
+DL_TARGET("avx2") static inline void
+Store4_AVX2(unsigned char *dst, __m256i c0, __m256i c1, __m256i c2)
+{
+    __m256i p0, p1, p2, p3;
+
+    Interleave4_AVX2(c0, c1, c2, p0, p1, p2, p3);
+    _mm256_storeu_si256((__m256i*)(dst),      _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + 64), _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256((__m256i*)(dst + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+DL_TARGET("avx2") static inline void
+StorePixels_AVX2(PackedRgb, unsigned char *dst, __m256i r, __m256i g, __m256i b)  { StoreRgb_AVX2(dst, r, g, b); }
+DL_TARGET("avx2") static inline void
+StorePixels_AVX2(PackedRgba, unsigned char *dst, __m256i r, __m256i g, __m256i b) { Store4_AVX2(dst, r, g, b); }
+DL_TARGET("avx2") static inline void
+StorePixels_AVX2(PackedBgra, unsigned char *dst, __m256i r, __m256i g, __m256i b) { Store4_AVX2(dst, b, g, r); }
+
+// the lower lane of x to lower, the upper to upper
+DL_TARGET("avx2") static inline void
+StoreLanes_AVX2(unsigned char *lower, unsigned char *upper, __m256i x)
+{
+    _mm_storeu_si128((__m128i*)lower, _mm256_castsi256_si128(x));
+    _mm_storeu_si128((__m128i*)upper, _mm256_extracti128_si256(x, 1));
+}
+
+// StorePixels_AVX2 for two separate runs of 16 pixels, one per lane. Each
+// lane goes straight to its own destination, without the permutes that put
+// the lanes back together.
+DL_TARGET("avx2") static inline void
+StoreRgbLanes_AVX2(unsigned char *lower, unsigned char *upper, __m256i r, __m256i g, __m256i b)
+{
+    __m256i out0, out1, out2;
+
+    InterleaveRgb_AVX2(r, g, b, out0, out1, out2);
+    StoreLanes_AVX2(lower,      upper,      out0);
+    StoreLanes_AVX2(lower + 16, upper + 16, out1);
+    StoreLanes_AVX2(lower + 32, upper + 32, out2);
+}
+
+DL_TARGET("avx2") static inline void
+Store4Lanes_AVX2(unsigned char *lower, unsigned char *upper, __m256i c0, __m256i c1, __m256i c2)
+{
+    __m256i p0, p1, p2, p3;
+
+    Interleave4_AVX2(c0, c1, c2, p0, p1, p2, p3);
+    StoreLanes_AVX2(lower,      upper,      p0);
+    StoreLanes_AVX2(lower + 16, upper + 16, p1);
+    StoreLanes_AVX2(lower + 32, upper + 32, p2);
+    StoreLanes_AVX2(lower + 48, upper + 48, p3);
+}
+
+DL_TARGET("avx2") static inline void
+StorePixelLanes_AVX2(PackedRgb, unsigned char *lower, unsigned char *upper, __m256i r, __m256i g, __m256i b)  { StoreRgbLanes_AVX2(lower, upper, r, g, b); }
+DL_TARGET("avx2") static inline void
+StorePixelLanes_AVX2(PackedRgba, unsigned char *lower, unsigned char *upper, __m256i r, __m256i g, __m256i b) { Store4Lanes_AVX2(lower, upper, r, g, b); }
+DL_TARGET("avx2") static inline void
+StorePixelLanes_AVX2(PackedBgra, unsigned char *lower, unsigned char *upper, __m256i r, __m256i g, __m256i b) { Store4Lanes_AVX2(lower, upper, b, g, r); }
+
+// 16 pixels of UYVY from lower into the lower lanes of lo and hi, 16 from
+// upper into the upper lanes
+DL_TARGET("avx2") static inline void
+LoadUyvyLanes_AVX2(const unsigned char *lower, const unsigned char *upper, __m256i &lo, __m256i &hi)
+{
+    lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(lower))),
+                                 _mm_loadu_si128((const __m128i*)(upper)), 1);
+    hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(lower + 16))),
+                                 _mm_loadu_si128((const __m128i*)(upper + 16)), 1);
+}
+
+// 32 pixels of UYVY as pixels 0-7 and 16-23 in lo, 8-15 and 24-31 in hi.
+// Loaded that way, the chroma terms pack in order and Channel_AVX2 doesn't
+// have to shuffle its result back.
+DL_TARGET("avx2") static inline void
+LoadUyvy_AVX2(const unsigned char *uyvy, __m256i &lo, __m256i &hi)
+{
+    LoadUyvyLanes_AVX2(uyvy, uyvy + 32, lo, hi);
+}
+
+template<class C>
+DL_TARGET("avx2") static inline void
+DecodeLuma_AVX2(__m256i lo, __m256i hi, __m256i &y_a, __m256i &y_b)
+{
+    y_a = Luma_AVX2<C>::Apply(_mm256_srli_epi16(lo, 8));
+    y_b = Luma_AVX2<C>::Apply(_mm256_srli_epi16(hi, 8));
+}
+
+// the chroma terms of the 16 macropixels in lo and hi, in the same order
+// as the pixels
+template<class C>
+DL_TARGET("avx2") static inline void
+DecodeChroma_AVX2(__m256i lo, __m256i hi, __m256i &r, __m256i &g, __m256i &b)
+{
+    const __m256i low_byte = _mm256_set1_epi16(0x00ff);
+    const __m256i bias     = _mm256_set1_epi16(128);
+    const __m256i coef_r   = _mm256_set1_epi32(DL_COEF_PAIR(0, C::RV));
+    const __m256i coef_g   = _mm256_set1_epi32(DL_COEF_PAIR(-C::GU, -C::GV));
+    const __m256i coef_b   = _mm256_set1_epi32(DL_COEF_PAIR(C::BU, 0));
+
+    __m256i uv_a = _mm256_sub_epi16(_mm256_and_si256(lo, low_byte), bias);
+    __m256i uv_b = _mm256_sub_epi16(_mm256_and_si256(hi, low_byte), bias);
+
+    r = ChromaTerm_AVX2(uv_a, uv_b, coef_r);
+    g = ChromaTerm_AVX2(uv_a, uv_b, coef_g);
+    b = ChromaTerm_AVX2(uv_a, uv_b, coef_b);
+}
+
+// MidTerm_SSSE3 in each lane, for terms laid out as UyvyToRgb_AVX2 keeps
+// them for linear chroma
+DL_TARGET("avx2") static inline __m256i
+MidTerm_AVX2(__m256i term, __m256i next)
+{
+    __m256i after = _mm256_alignr_epi8(next, term, 2);
+    return _mm256_mulhrs_epi16(_mm256_add_epi16(term, after), _mm256_set1_epi16(0x4000));
+}
+
+// 32 pixels of UYVY to 32 bytes each of red, green and blue, in order
+template<class C>
+DL_TARGET("avx2") static inline void
+DecodeRgb_AVX2(const unsigned char *uyvy, __m256i &r, __m256i &g, __m256i &b)
+{
+    __m256i lo, hi, y_a, y_b, term_r, term_g, term_b;
+
+    LoadUyvy_AVX2(uyvy, lo, hi);
+    DecodeLuma_AVX2<C>(lo, hi, y_a, y_b);
+    DecodeChroma_AVX2<C>(lo, hi, term_r, term_g, term_b);
+
+    r = Channel_AVX2(y_a, y_b, term_r, term_r);
+    g = Channel_AVX2(y_a, y_b, term_g, term_g);
+    b = Channel_AVX2(y_a, y_b, term_b, term_b);
+}
+
+// Linear chroma splits the row in two and runs down both halves at once,
+// the first in the lower lanes and the second in the upper. Each lane then
+// carries its own terms along as in UyvyToRgb_SSSE3, so finding the term
+// after each one and storing the pixels never has to cross lanes. The halves
+// are a whole number of 16 pixel steps, and at least 16 pixels are left over
+// after the second for the last terms it needs; UyvyToRgb_SSSE3 does those.
+template<class C, class L, bool Linear>
+DL_TARGET("avx2") static void
+UyvyToRgb_AVX2(const unsigned char *uyvy, unsigned char *rgb, long numPixels)
+{
+    __m256i r, g, b;
+
+    long i = 0;
+    if(Linear) {
+        const long half = ((numPixels - 16) / 2) & ~15L;
+
+        __m256i lo, hi, next_lo, next_hi, y_a, y_b, term_r, term_g, term_b, next_r, next_g, next_b;
+
+        const unsigned char *upper = uyvy + half*2;
+        unsigned char *rgb_upper = rgb + half*L::Bytes;
+
+        if(half > 0) {
+            LoadUyvyLanes_AVX2(uyvy, upper, lo, hi);
+            DecodeChroma_AVX2<C>(lo, hi, term_r, term_g, term_b);
+        }
+
+        for(; i < half; i += 16, uyvy += 32, upper += 32, rgb += 16*L::Bytes, rgb_upper += 16*L::Bytes) {
+            LoadUyvyLanes_AVX2(uyvy + 32, upper + 32, next_lo, next_hi);
+            DecodeLuma_AVX2<C>(lo, hi, y_a, y_b);
+            DecodeChroma_AVX2<C>(next_lo, next_hi, next_r, next_g, next_b);
+
+            r = Channel_AVX2(y_a, y_b, term_r, MidTerm_AVX2(term_r, next_r));
+            g = Channel_AVX2(y_a, y_b, term_g, MidTerm_AVX2(term_g, next_g));
+            b = Channel_AVX2(y_a, y_b, term_b, MidTerm_AVX2(term_b, next_b));
+            StorePixelLanes_AVX2(L(), rgb, rgb_upper, r, g, b);
+
+            lo = next_lo;
+            hi = next_hi;
+            term_r = next_r;
+            term_g = next_g;
+            term_b = next_b;
+        }
+
+        if(half > 0) {
+            uyvy = upper;
+            rgb = rgb_upper;
+            i = half*2;
+        }
+    } else {
+        for(; i + 32 <= numPixels; i += 32, uyvy += 64, rgb += 32*L::Bytes) {
+            DecodeRgb_AVX2<C>(uyvy, r, g, b);
+            StorePixels_AVX2(L(), rgb, r, g, b);
+        }
+    }
+
+    UyvyToRgb_SSSE3<C, L, Linear>(uyvy, rgb, numPixels - i);
+}
+
+DL_TARGET("avx2") static void
+AccumulateRow_AVX2(const unsigned char *src, unsigned short *sums, long numBytes)
+{
+    long i = 0;
+    for(; i + 16 <= numBytes; i += 16) {
+        __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(sums + i));
+        _mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(s, x));
+    }
+
+    AccumulateRow_Scalar(src + i, sums + i, numBytes - i);
+}
+
+// HalveBoxSums_SSSE3 across both lanes, put back in order afterwards so the
+// 4:1 pass pairs up neighbouring macropixels
+DL_TARGET("avx2") static inline __m256i
+HalveBoxSums_AVX2(__m256i a, __m256i b)
+{
+    const __m256i order = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 10, 11, 8, 9, 6, 7, 12, 13, 14, 15,
+                                           0, 1, 2, 3, 4, 5, 10, 11, 8, 9, 6, 7, 12, 13, 14, 15);
+
+    a = _mm256_shuffle_epi8(a, order);
+    b = _mm256_shuffle_epi8(b, order);
+    return _mm256_permute4x64_epi64(_mm256_add_epi16(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b)), 0xd8);
+}
+
+// sums for the next four output macropixels
+template<int Ratio> DL_TARGET("avx2") static inline __m256i BoxSums_AVX2(const unsigned short *sums);
+
+template<> DL_TARGET("avx2") inline __m256i
+BoxSums_AVX2<2>(const unsigned short *sums)
+{
+    return HalveBoxSums_AVX2(_mm256_loadu_si256((const __m256i*)sums), _mm256_loadu_si256((const __m256i*)(sums + 16)));
+}
+
+template<> DL_TARGET("avx2") inline __m256i
+BoxSums_AVX2<4>(const unsigned short *sums)
+{
+    return HalveBoxSums_AVX2(BoxSums_AVX2<2>(sums), BoxSums_AVX2<2>(sums + 32));
+}
+
+template<int Ratio>
+DL_TARGET("avx2") static void
+UyvyBoxDownscale_Ratio_AVX2(const unsigned short *sums, unsigned char *uyvy, long dstWidth, long numRows)
+{
+    BoxDivider16  d          = MakeBoxDivider16((unsigned int)(numRows * Ratio));
+    const __m256i half       = _mm256_set1_epi16((short)d.half);
+    const __m256i reciprocal = _mm256_set1_epi16((short)d.reciprocal);
+    const __m128i shift      = _mm_cvtsi32_si128(d.shift);
+
+    long x = 0;
+    for(; x + 16 <= dstWidth; x += 16, sums += Ratio * 32, uyvy += 32) {
+        __m256i lo = _mm256_srl_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(BoxSums_AVX2<Ratio>(sums), half), reciprocal), shift);
+        __m256i hi = _mm256_srl_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(BoxSums_AVX2<Ratio>(sums + Ratio * 16), half), reciprocal), shift);
+        _mm256_storeu_si256((__m256i*)uyvy, _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+    }
+
+    UyvyBoxDownscale_Ratio<Ratio>(sums, uyvy, dstWidth - x, MakeBoxDivider((unsigned int)(numRows * Ratio)));
+}
+
+static void
+UyvyBoxDownscale_AVX2(const BoxColumns &columns, const unsigned short *sums, long numRows, unsigned char *uyvy)
+{
+    if(columns.ratio == 0 || columns.ratio * numRows >= MAX_DIVIDER16_COUNT) {
+        UyvyBoxDownscale_Scalar(columns, sums, numRows, uyvy);
+        return;
+    }
+
+    if(columns.ratio == 2)
+        UyvyBoxDownscale_Ratio_AVX2<2>(sums, uyvy, columns.dstWidth, numRows);
+    else
+        UyvyBoxDownscale_Ratio_AVX2<4>(sums, uyvy, columns.dstWidth, numRows);
+}
+
+DL_TARGET("avx2") static void
+UyvyToGray_AVX2(const unsigned char *uyvy, unsigned char *gray, long numPixels)
+{
+    long i = 0;
+    for(; i + 32 <= numPixels; i += 32, uyvy += 64, gray += 32) {
+        __m256i a = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(uyvy)), 8);
+        __m256i b = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(uyvy + 32)), 8);
+        // the pack works within lanes, put the four quarters back in order
+        _mm256_storeu_si256((__m256i*)gray, _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+
+    UyvyToGray_SSSE3(uyvy, gray, numPixels - i);
+}
+
+// 16 r210 pixels to R, G and B in 16-bit lanes. The pack works within
+// 128-bit lanes, so they come out as pixels 0-3, 8-11, 4-7, 12-15.
+DL_TARGET("avx2") static inline void
+UnpackR210_AVX2(const unsigned char *r210, __m256i &r, __m256i &g, __m256i &b)
+{
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i mask = _mm256_set1_epi32(0x3ff);
+
+    __m256i w0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(r210)), swap);
+    __m256i w1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(r210 + 32)), swap);
+
+    r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(w0, 20), mask), _mm256_and_si256(_mm256_srli_epi32(w1, 20), mask));
+    g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(w0, 10), mask), _mm256_and_si256(_mm256_srli_epi32(w1, 10), mask));
+    b = _mm256_packs_epi32(_mm256_and_si256(w0, mask), _mm256_and_si256(w1, mask));
+}
+
+template<class V>
+DL_TARGET("avx2") static inline __m256i
+R210Level_AVX2(__m256i x)
+{
+    x = _mm256_sub_epi16(x, _mm256_set1_epi16(V::InOffset));
+    return _mm256_add_epi16(_mm256_mulhrs_epi16(x, _mm256_set1_epi16(V::K)), _mm256_set1_epi16(V::OutOffset));
+}
+
+// 32 pixels of a channel from two unpacks. Both packs shuffle the same way
+// within lanes, one permute puts all 32 back in order.
+template<class V>
+DL_TARGET("avx2") static inline __m256i
+R210Channel_AVX2(__m256i a, __m256i b)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(R210Level_AVX2<V>(a), R210Level_AVX2<V>(b)), order);
+}
+
+template<class V, class L>
+DL_TARGET("avx2") static void
+R210ToRgb_AVX2(const unsigned char *r210, unsigned char *rgb, long numPixels)
+{
+    __m256i r0, g0, b0, r1, g1, b1;
+
+    long i = 0;
+    for(; i + 32 <= numPixels; i += 32, r210 += 128, rgb += 32*L::Bytes) {
+        UnpackR210_AVX2(r210,      r0, g0, b0);
+        UnpackR210_AVX2(r210 + 64, r1, g1, b1);
+        StorePixels_AVX2(L(), rgb, R210Channel_AVX2<V>(r0, r1), R210Channel_AVX2<V>(g0, g1), R210Channel_AVX2<V>(b0, b1));
+    }
+
+    R210ToRgb_SSSE3<V, L>(r210, rgb, numPixels - i);
+}
+
+// Deep_SSSE3 on both lanes. y_lo holds pixels 0-3 and 4-7, y_hi 8-11 and
+// 12-15, so the pack needs a permute to leave the 16 pixels in order.
+DL_TARGET("avx2") static inline __m256i
+Deep_AVX2(__m256i y_lo, __m256i y_hi, __m256i term)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top  = _mm256_set1_epi16(1023);
+
+    __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(y_lo, _mm256_shuffle_epi32(term, 0x50)), 13);
+    __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(y_hi, _mm256_shuffle_epi32(term, 0xfa)), 13);
+    __m256i x  = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+    return _mm256_slli_epi16(_mm256_min_epi16(_mm256_max_epi16(x, zero), top), 6);
+}
+
+template<class C>
+DL_TARGET("avx2") static void
+Uyvy16ToRgb16_AVX2(const unsigned char *uyvy16, unsigned char *rgb16, long numPixels)
+{
+    typedef Coefficients10<C> K;
+    const __m256i luma   = _mm256_setr_epi8(2, 3, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1,
+                                            2, 3, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1);
+    const __m256i chroma = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i yk     = _mm256_set1_epi32(K::YK);
+    const __m256i bias   = _mm256_set1_epi32(K::Bias);
+    const __m256i coef_r = _mm256_set1_epi32(DL_COEF_PAIR(0, K::RV));
+    const __m256i coef_g = _mm256_set1_epi32(DL_COEF_PAIR(-K::GU, -K::GV));
+    const __m256i coef_b = _mm256_set1_epi32(DL_COEF_PAIR(K::BU, 0));
+
+    long i = 0;
+    for(; i + 16 <= numPixels; i += 16, uyvy16 += 64, rgb16 += 96) {
+        __m256i a = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(uyvy16)), 6);
+        __m256i b = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(uyvy16 + 32)), 6);
+
+        __m256i y_lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_shuffle_epi8(a, luma), yk), bias);
+        __m256i y_hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_shuffle_epi8(b, luma), yk), bias);
+        __m256i uv   = _mm256_sub_epi16(_mm256_unpacklo_epi64(_mm256_shuffle_epi8(a, chroma), _mm256_shuffle_epi8(b, chroma)),
+                                        _mm256_set1_epi16(512));
+
+        __m256i red   = Deep_AVX2(y_lo, y_hi, _mm256_madd_epi16(uv, coef_r));
+        __m256i green = Deep_AVX2(y_lo, y_hi, _mm256_madd_epi16(uv, coef_g));
+        __m256i blue  = Deep_AVX2(y_lo, y_hi, _mm256_madd_epi16(uv, coef_b));
+
+        StoreRgb16_SSSE3(rgb16,      _mm256_castsi256_si128(red), _mm256_castsi256_si128(green), _mm256_castsi256_si128(blue));
+        StoreRgb16_SSSE3(rgb16 + 48, _mm256_extracti128_si256(red, 1), _mm256_extracti128_si256(green, 1), _mm256_extracti128_si256(blue, 1));
+    }
+
+    Uyvy16ToRgb16_SSSE3<C>(uyvy16, rgb16, numPixels - i);
+}
+
+DL_TARGET("avx2") static void
+ArgbToBgra_AVX2(const unsigned char *argb, unsigned char *bgra, long numPixels)
+{
+    const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    long i = 0;
+    for(; i + 8 <= numPixels; i += 8, argb += 32, bgra += 32)
+        _mm256_storeu_si256((__m256i*)bgra, _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)argb), reverse));
+
+    ArgbToBgra_SSSE3(argb, bgra, numPixels - i);
+}
+
+DL_TARGET("avx2") static inline __m256
+Normalize_AVX2(const unsigned char *bytes, __m256 scale, __m256 bias)
+{
+    __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)bytes));
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(x), scale), bias);
+}
+
+DL_TARGET("avx2") static inline void
+Store8_AVX2(float *dst, __m256 value)
+{
+    _mm256_storeu_ps(dst, value);
+}
+
+DL_TARGET("avx2,f16c") static inline void
+Store8_AVX2(unsigned short *dst, __m256 value)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm256_cvtps_ph(value, 0));   // round to nearest even
+}
+
+template<bool Planar>
+DL_TARGET("avx2") static inline void
+FloatPatterns_AVX2(const Normalization &norm, __m256 scale[3], __m256 bias[3])
+{
+    for(int o=0; o<3; o++) {
+        float s[8], b[8];
+        for(int l=0; l<8; l++) {
+            int c = Planar ? o : (o + l) % 3;
+            s[l]  = norm.scale[c];
+            b[l]  = -norm.mean[c] * norm.scale[c];
+        }
+        scale[o] = _mm256_loadu_ps(s);
+        bias[o]  = _mm256_loadu_ps(b);
+    }
+}
+
+template<class C, class T, bool Planar>
+DL_TARGET("avx2,f16c") static void
+UyvyToFloat_AVX2(const unsigned char *uyvy, unsigned char *const dst[3], const Normalization &norm, long numPixels)
+{
+    T             *out[3] = { (T*)dst[0], (T*)dst[1], (T*)dst[2] };
+    __m256         scale[3], bias[3];
+    unsigned char  bytes[96];
+    __m256i        r, g, b;
+
+    FloatPatterns_AVX2<Planar>(norm, scale, bias);
+
+    long i = 0;
+    for(; i + 32 <= numPixels; i += 32, uyvy += 64) {
+        DecodeRgb_AVX2<C>(uyvy, r, g, b);
+
+        if(Planar) {
+            _mm256_storeu_si256((__m256i*)(bytes),      r);
+            _mm256_storeu_si256((__m256i*)(bytes + 32), g);
+            _mm256_storeu_si256((__m256i*)(bytes + 64), b);
+            for(int c=0; c<3; c++)
+                for(int q=0; q<4; q++)
+                    Store8_AVX2(out[c] + i + q*8, Normalize_AVX2(bytes + c*32 + q*8, scale[c], bias[c]));
+        } else {
+            // vector m starts on float 8m, which is channel (8m) % 3
+            StoreRgb_AVX2(bytes, r, g, b);
+            for(int m=0; m<12; m++)
+                Store8_AVX2(out[0] + i*3 + m*8, Normalize_AVX2(bytes + m*8, scale[(m*8) % 3], bias[(m*8) % 3]));
+        }
+    }
+
+    unsigned char *rest[3];
+    AdvanceFloatRow<T, Planar>(dst, i, rest);
+    UyvyToFloat_SSSE3<C, T, Planar>(uyvy, rest, norm, numPixels - i);
+}
+
+// 8 pixels of any layout as 32-bit lanes, channels at the layout's offsets
+template<class L>
+DL_TARGET("avx2") static inline __m256i
+LoadPixels8_AVX2(const unsigned char *pixels)
+{
+    if(L::Bytes == 4)
+        return _mm256_loadu_si256((const __m256i*)pixels);
+
+    // 24 bytes of RGB, read as bytes 0-15 and 8-23 so nothing past the 8
+    // pixels gets touched
+    const __m128i lo = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1,  9, 10, 11, -1);
+    const __m128i hi = _mm_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pixels), lo);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pixels + 8)), hi);
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1);
+}
+
+template<class L>
+DL_TARGET("avx2") static inline void
+StorePixels8_AVX2(unsigned char *pixels, __m256i x)
+{
+    if(L::Bytes == 4) {
+        _mm256_storeu_si256((__m256i*)pixels, x);
+        return;
+    }
+
+    // exactly 24 bytes, the next pixels haven't been read yet
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m128i a = _mm_shuffle_epi8(_mm256_castsi256_si128(x), pack);
+    __m128i b = _mm_shuffle_epi8(_mm256_extracti128_si256(x, 1), pack);
+    _mm_storeu_si128((__m128i*)pixels, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+    _mm_storel_epi64((__m128i*)(pixels + 16), _mm_srli_si128(b, 4));
+}
+
+DL_TARGET("avx2") static inline void
+LutCoord_AVX2(__m256i value, __m256i step, __m256i last, __m256i &index, __m256i &frac)
+{
+    __m256i p = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(value, step), _mm256_set1_epi32(128)), 8);
+    index = _mm256_min_epi32(_mm256_srli_epi32(p, 8), last);
+    frac  = _mm256_sub_epi32(p, _mm256_slli_epi32(index, 8));
+}
+
+template<int Shift>
+DL_TARGET("avx2") static inline __m256i
+LutBlend_AVX2(const __m256i c[4], const __m256i w[4])
+{
+    const __m256i mask = _mm256_set1_epi32(1023);
+
+    __m256i sum = _mm256_set1_epi32(512);
+    for(int k=0; k<4; k++)
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(w[k], _mm256_and_si256(_mm256_srli_epi32(c[k], Shift), mask)));
+    return _mm256_srli_epi32(sum, 10);
+}
+
+// Same math as ApplyLut3D_Scalar, 8 pixels at a time with the four corners
+// fetched by gathers.
+template<class L>
+DL_TARGET("avx2") static void
+ApplyLut3D_AVX2(const Lut3D &lut, unsigned char *pixels, long numPixels)
+{
+    const int    *entries = (const int*)&lut.entries[0];
+    const int     n       = lut.size;
+    const __m256i step    = _mm256_set1_epi32(LutStep(n));
+    const __m256i last    = _mm256_set1_epi32(n - 2);
+    const __m256i sr      = _mm256_set1_epi32(1);
+    const __m256i sg      = _mm256_set1_epi32(n);
+    const __m256i sb      = _mm256_set1_epi32(n * n);
+    const __m256i sall    = _mm256_set1_epi32(1 + n + n * n);
+    const __m256i byte    = _mm256_set1_epi32(0xff);
+    const __m256i alpha   = _mm256_set1_epi32(L::Bytes == 4 ? (0xff << (8 * L::A)) : 0);
+
+    long i = 0;
+    for(; i + 8 <= numPixels; i += 8, pixels += 8*L::Bytes) {
+        __m256i px = LoadPixels8_AVX2<L>(pixels);
+
+        __m256i ir, fr, ig, fg, ib, fb;
+        LutCoord_AVX2(_mm256_and_si256(_mm256_srli_epi32(px, 8 * L::R), byte), step, last, ir, fr);
+        LutCoord_AVX2(_mm256_and_si256(_mm256_srli_epi32(px, 8 * L::G), byte), step, last, ig, fg);
+        LutCoord_AVX2(_mm256_and_si256(_mm256_srli_epi32(px, 8 * L::B), byte), step, last, ib, fb);
+
+        __m256i fmax = _mm256_max_epi32(_mm256_max_epi32(fr, fg), fb);
+        __m256i fmin = _mm256_min_epi32(_mm256_min_epi32(fr, fg), fb);
+        __m256i fmid = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(fr, fg), fb), _mm256_add_epi32(fmax, fmin));
+
+        __m256i smax = _mm256_blendv_epi8(sb,   sg, _mm256_cmpeq_epi32(fg, fmax));
+                smax = _mm256_blendv_epi8(smax, sr, _mm256_cmpeq_epi32(fr, fmax));
+        __m256i smin = _mm256_blendv_epi8(sr,   sg, _mm256_cmpeq_epi32(fg, fmin));
+                smin = _mm256_blendv_epi8(smin, sb, _mm256_cmpeq_epi32(fb, fmin));
+
+        __m256i cell = _mm256_add_epi32(ir, _mm256_add_epi32(_mm256_mullo_epi32(ig, sg), _mm256_mullo_epi32(ib, sb)));
+        __m256i c[4], w[4];
+        c[0] = _mm256_i32gather_epi32(entries, cell, 4);
+        c[1] = _mm256_i32gather_epi32(entries, _mm256_add_epi32(cell, smax), 4);
+        c[2] = _mm256_i32gather_epi32(entries, _mm256_sub_epi32(_mm256_add_epi32(cell, sall), smin), 4);
+        c[3] = _mm256_i32gather_epi32(entries, _mm256_add_epi32(cell, sall), 4);
+        w[0] = _mm256_sub_epi32(_mm256_set1_epi32(256), fmax);
+        w[1] = _mm256_sub_epi32(fmax, fmid);
+        w[2] = _mm256_sub_epi32(fmid, fmin);
+        w[3] = fmin;
+
+        __m256i out = _mm256_and_si256(px, alpha);
+        out = _mm256_or_si256(out, _mm256_slli_epi32(LutBlend_AVX2<0>(c, w),  8 * L::R));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(LutBlend_AVX2<10>(c, w), 8 * L::G));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(LutBlend_AVX2<20>(c, w), 8 * L::B));
+        StorePixels8_AVX2<L>(pixels, out);
+    }
+
+    ApplyLut3D_Scalar<L>(lut, pixels, numPixels - i);
+}
+
+DL_TARGET("avx2") static inline __m256i
+ToneEotf_AVX2(const ToneMapTables &t, __m256i sum)
+{
+    __m256i code = _mm256_srai_epi32(sum, 13);
+    code = _mm256_min_epi32(_mm256_max_epi32(code, _mm256_setzero_si256()), _mm256_set1_epi32(TONE_EOTF_SIZE - 1));
+    return _mm256_i32gather_epi32(t.eotf, code, 4);
+}
+
+// The OETF table is bytes, so each gather reads the entry plus the three
+// after it (hence the padding) and the mask keeps the one we want.
+DL_TARGET("avx2") static inline __m256i
+ToneOut_AVX2(const ToneMapTables &t, __m256i r, __m256i g, __m256i b, int k)
+{
+    __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(t.gamut[k*3])),
+                                   _mm256_mullo_epi32(g, _mm256_set1_epi32(t.gamut[k*3 + 1])));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(b, _mm256_set1_epi32(t.gamut[k*3 + 2])));
+
+    __m256i index = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(32768)), 16);
+    index = _mm256_min_epi32(_mm256_max_epi32(index, _mm256_setzero_si256()), _mm256_set1_epi32(TONE_OETF_SIZE - 1));
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*)t.oetf, index, 1), _mm256_set1_epi32(0xff));
+}
+
+// Same math as Uyvy16ToneMap_Scalar, 8 pixels at a time with the table
+// lookups done by gathers. Each lane holds two macropixels, which the
+// shuffles spread out to a 32-bit Y, U and V per pixel.
+template<class L>
+DL_TARGET("avx2") static void
+Uyvy16ToneMap_AVX2(const ToneMapTables &t, const unsigned char *uyvy16, unsigned char *rgb, long numPixels)
+{
+    const __m256i pick_y = _mm256_setr_epi8(2, 3, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1,
+                                            2, 3, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1);
+    const __m256i pick_u = _mm256_setr_epi8(0, 1, -1, -1, 0, 1, -1, -1,  8,  9, -1, -1,  8,  9, -1, -1,
+                                            0, 1, -1, -1, 0, 1, -1, -1,  8,  9, -1, -1,  8,  9, -1, -1);
+    const __m256i pick_v = _mm256_setr_epi8(4, 5, -1, -1, 4, 5, -1, -1, 12, 13, -1, -1, 12, 13, -1, -1,
+                                            4, 5, -1, -1, 4, 5, -1, -1, 12, 13, -1, -1, 12, 13, -1, -1);
+    const __m256i center = _mm256_set1_epi32(512);
+    const __m256i yk     = _mm256_set1_epi32(t.yk);
+    const __m256i bias   = _mm256_set1_epi32(t.bias);
+    const __m256i rv     = _mm256_set1_epi32(t.rv);
+    const __m256i gu     = _mm256_set1_epi32(t.gu);
+    const __m256i gv     = _mm256_set1_epi32(t.gv);
+    const __m256i bu     = _mm256_set1_epi32(t.bu);
+    const __m256i alpha  = _mm256_set1_epi32(L::Bytes == 4 ? (0xff << (8 * L::A)) : 0);
+
+    long i = 0;
+    for(; i + 8 <= numPixels; i += 8, uyvy16 += 32, rgb += 8*L::Bytes) {
+        __m256i px = _mm256_loadu_si256((const __m256i*)uyvy16);
+        __m256i y  = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(_mm256_shuffle_epi8(px, pick_y), 6), yk), bias);
+        __m256i u  = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_shuffle_epi8(px, pick_u), 6), center);
+        __m256i v  = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_shuffle_epi8(px, pick_v), 6), center);
+
+        __m256i r = ToneEotf_AVX2(t, _mm256_add_epi32(y, _mm256_mullo_epi32(v, rv)));
+        __m256i g = ToneEotf_AVX2(t, _mm256_sub_epi32(_mm256_sub_epi32(y, _mm256_mullo_epi32(u, gu)), _mm256_mullo_epi32(v, gv)));
+        __m256i b = ToneEotf_AVX2(t, _mm256_add_epi32(y, _mm256_mullo_epi32(u, bu)));
+
+        __m256i out = alpha;
+        out = _mm256_or_si256(out, _mm256_slli_epi32(ToneOut_AVX2(t, r, g, b, 0), 8 * L::R));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(ToneOut_AVX2(t, r, g, b, 1), 8 * L::G));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(ToneOut_AVX2(t, r, g, b, 2), 8 * L::B));
+        StorePixels8_AVX2<L>(rgb, out);
+    }
+
+    Uyvy16ToneMap_Scalar<L>(t, uyvy16, rgb, numPixels - i);
+}
+
+#endif // DL_HAVE_AVX2
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+////////////////////////////////////////////////////////////////////////////////
+
+template<class C, class L, bool Linear>
+static RowFn
+SelectUyvyToRgb(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &UyvyToRgb_AVX2<C, L, Linear>;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &UyvyToRgb_SSSE3<C, L, Linear>;
+#endif
+        default:        return &UyvyToRgb_Scalar<C, L, Linear>;
+    }
+}
+
+template<class C, class L>
+static RowFn
+SelectUyvyToRgb(Isa isa, ChromaUpsampling chroma)
+{
+    if(chroma == CHROMA_LINEAR)
+        return SelectUyvyToRgb<C, L, true>(isa);
+    return SelectUyvyToRgb<C, L, false>(isa);
+}
+
+template<class C>
+static RowFn
+SelectUyvyToRgb(Isa isa, Layout layout, ChromaUpsampling chroma)
+{
+    switch(layout) {
+        case LAYOUT_RGBA: return SelectUyvyToRgb<C, PackedRgba>(isa, chroma);
+        case LAYOUT_BGRA: return SelectUyvyToRgb<C, PackedBgra>(isa, chroma);
+        default:          return SelectUyvyToRgb<C, PackedRgb>(isa, chroma);
+    }
+}
+
+// Calls F::Run<Coefficients<...> >(arg) for the runtime colorimetry, so every
+// combination gets its own instantiation of whatever F does.
+template<class F, class M, class In>
+static typename F::Result
+DispatchOutputRange(const Colorimetry &c, typename F::Arg arg)
+{
+    if(c.outputRange == RANGE_LIMITED)
+        return F::template Run< Coefficients<M, In, LimitedRange> >(arg);
+    return F::template Run< Coefficients<M, In, FullRange> >(arg);
+}
+
+template<class F, class M>
+static typename F::Result
+DispatchInputRange(const Colorimetry &c, typename F::Arg arg)
+{
+    if(c.inputRange == RANGE_LIMITED)
+        return DispatchOutputRange<F, M, LimitedRange>(c, arg);
+    return DispatchOutputRange<F, M, FullRange>(c, arg);
+}
+
+template<class F>
+static typename F::Result
+DispatchColorimetry(const Colorimetry &c, typename F::Arg arg)
+{
+    if(c.matrix == MATRIX_BT709)
+        return DispatchInputRange<F, Bt709>(c, arg);
+    return DispatchInputRange<F, Bt601>(c, arg);
+}
+
+RowFn
+GetUyvyToGray(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &UyvyToGray_AVX2;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &UyvyToGray_SSSE3;
+#endif
+        default:        return &UyvyToGray_Scalar;
+    }
+}
+
+// there's nothing for AVX2 to win on the v210 unpackers, they're load/store bound
+RowFn
+GetV210ToUyvy(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &V210ToUyvy_SSSE3;
+#endif
+    return &V210ToUyvy_Scalar;
+}
+
+RowFn
+GetV210ToUyvy16(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &V210ToUyvy16_SSSE3;
+#endif
+    return &V210ToUyvy16_Scalar;
+}
+
+RowFn
+GetV210ToGray(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &V210ToGray_SSSE3;
+#endif
+    return &V210ToGray_Scalar;
+}
+
+RowFn
+GetV210ToGray16(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &V210ToGray16_SSSE3;
+#endif
+    return &V210ToGray16_Scalar;
+}
+
+RowFn
+GetArgbToBgra(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &ArgbToBgra_AVX2;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &ArgbToBgra_SSSE3;
+#endif
+        default:        return &ArgbToBgra_Scalar;
+    }
+}
+
+template<class V, class L>
+static RowFn
+SelectR210ToRgb(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &R210ToRgb_AVX2<V, L>;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &R210ToRgb_SSSE3<V, L>;
+#endif
+        default:        return &R210ToRgb_Scalar<V, L>;
+    }
+}
+
+template<class In, class Out>
+static RowFn
+SelectR210ToRgb(Isa isa, Layout layout)
+{
+    switch(layout) {
+        case LAYOUT_RGBA: return SelectR210ToRgb<RgbLevels<In, Out>, PackedRgba>(isa);
+        case LAYOUT_BGRA: return SelectR210ToRgb<RgbLevels<In, Out>, PackedBgra>(isa);
+        default:          return SelectR210ToRgb<RgbLevels<In, Out>, PackedRgb>(isa);
+    }
+}
+
+// only the ranges matter for RGB, there's no matrix to dispatch on
+RowFn
+GetR210ToRgb(Isa isa, const Colorimetry &colorimetry, Layout layout)
+{
+    if(colorimetry.inputRange == RANGE_LIMITED) {
+        if(colorimetry.outputRange == RANGE_LIMITED)
+            return SelectR210ToRgb<LimitedRange, LimitedRange>(isa, layout);
+        return SelectR210ToRgb<LimitedRange, FullRange>(isa, layout);
+    }
+    if(colorimetry.outputRange == RANGE_LIMITED)
+        return SelectR210ToRgb<FullRange, LimitedRange>(isa, layout);
+    return SelectR210ToRgb<FullRange, FullRange>(isa, layout);
+}
+
+// load/store bound, AVX2 doesn't buy anything
+RowFn
+GetR210ToRgb16(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &R210ToRgb16_SSSE3;
+#endif
+    return &R210ToRgb16_Scalar;
+}
+
+AccumulateFn
+GetAccumulateRow(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &AccumulateRow_AVX2;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &AccumulateRow_SSSE3;
+#endif
+        default:        return &AccumulateRow_Scalar;
+    }
+}
+
+BoxDownscaleFn
+GetUyvyBoxDownscale(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &UyvyBoxDownscale_AVX2;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &UyvyBoxDownscale_SSSE3;
+#endif
+        default:        return &UyvyBoxDownscale_Scalar;
+    }
+}
+
+// load/store bound like the v210 unpackers
+RowPairFn
+GetUyvyToNv12(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &UyvyTo420_SSSE3<true>;
+#endif
+    return &UyvyTo420_Scalar<true>;
+}
+
+RowPairFn
+GetUyvyToI420(Isa isa)
+{
+#ifdef DL_HAVE_SSSE3
+    if(isa >= ISA_SSSE3)
+        return &UyvyTo420_SSSE3<false>;
+#endif
+    return &UyvyTo420_Scalar<false>;
+}
+
+template<class C, class T, bool Planar>
+static FloatRowFn
+SelectUyvyToFloat(Isa isa)
+{
+    switch(isa) {
+#ifdef DL_HAVE_AVX2
+        case ISA_AVX2:  return &UyvyToFloat_AVX2<C, T, Planar>;
+#endif
+#ifdef DL_HAVE_SSSE3
+        case ISA_SSSE3: return &UyvyToFloat_SSSE3<C, T, Planar>;
+#endif
+        default:        return &UyvyToFloat_Scalar<C, T, Planar>;
+    }
+}
+
+struct UyvyToFloatSelector
+{
+    struct Request { Isa isa; FloatFormat format; bool planar; };
+
+    typedef FloatRowFn      Result;
+    typedef const Request&  Arg;
+    template<class C> static Result Run(Arg req)
+    {
+        if(req.format == FLOAT_16)
+            return req.planar ? SelectUyvyToFloat<C, unsigned short, true>(req.isa)
+                              : SelectUyvyToFloat<C, unsigned short, false>(req.isa);
+        return req.planar ? SelectUyvyToFloat<C, float, true>(req.isa)
+                          : SelectUyvyToFloat<C, float, false>(req.isa);
+    }
+};
+
+struct UyvyToRgbSelector
+{
+    struct Request { Isa isa; Layout layout; ChromaUpsampling chroma; };
+
+    typedef RowFn           Result;
+    typedef const Request&  Arg;
+    template<class C> static Result Run(Arg req) { return SelectUyvyToRgb<C>(req.isa, req.layout, req.chroma); }
+};
+
+struct Uyvy16ToRgb16Selector
+{
+    typedef RowFn   Result;
+    typedef Isa     Arg;
+    template<class C> static Result Run(Arg isa)
+    {
+        switch(isa) {
+#ifdef DL_HAVE_AVX2
+            case ISA_AVX2:  return &Uyvy16ToRgb16_AVX2<C>;
+#endif
+#ifdef DL_HAVE_SSSE3
+            case ISA_SSSE3: return &Uyvy16ToRgb16_SSSE3<C>;
+#endif
+            default:        return &Uyvy16ToRgb16_Scalar<C>;
+        }
+    }
+};
+
+struct LookupTableBuilder
+{
+    typedef void            Result;
+    typedef LookupTables&   Arg;
+    template<class C> static Result Run(Arg lut) { CreateLookupTables<C>(lut); }
+};
+
+RowFn
+GetUyvyToRgb(Isa isa, const Colorimetry &colorimetry, Layout layout, ChromaUpsampling chroma)
+{
+    UyvyToRgbSelector::Request req = { isa, layout, chroma };
+    return DispatchColorimetry<UyvyToRgbSelector>(colorimetry, req);
+}
+
+RowFn
+GetUyvy16ToRgb16(Isa isa, const Colorimetry &colorimetry)
+{
+    return DispatchColorimetry<Uyvy16ToRgb16Selector>(colorimetry, isa);
+}
+
+FloatRowFn
+GetUyvyToFloat(Isa isa, const Colorimetry &colorimetry, FloatFormat format, bool planar)
+{
+    UyvyToFloatSelector::Request req = { isa, format, planar };
+    return DispatchColorimetry<UyvyToFloatSelector>(colorimetry, req);
+}
+
+void
+CreateLookupTables(LookupTables &lut, const Colorimetry &colorimetry)
+{
+    DispatchColorimetry<LookupTableBuilder>(colorimetry, lut);
+    lut.colorimetry = colorimetry;
+}
+
+// SSSE3 has no gathers, so it gets the scalar kernel
+template<class L>
+static Lut3DFn
+SelectApplyLut3D(Isa isa)
+{
+#ifdef DL_HAVE_AVX2
+    if(isa >= ISA_AVX2)
+        return &ApplyLut3D_AVX2<L>;
+#endif
+    return &ApplyLut3D_Scalar<L>;
+}
+
+Lut3DFn
+GetApplyLut3D(Isa isa, Layout layout)
+{
+    switch(layout) {
+        case LAYOUT_RGBA: return SelectApplyLut3D<PackedRgba>(isa);
+        case LAYOUT_BGRA: return SelectApplyLut3D<PackedBgra>(isa);
+        default:          return SelectApplyLut3D<PackedRgb>(isa);
+    }
+}
+
+// SSSE3 has no gathers for the tables either
+template<class L>
+static ToneMapFn
+SelectUyvy16ToneMap(Isa isa)
+{
+#ifdef DL_HAVE_AVX2
+    if(isa >= ISA_AVX2)
+        return &Uyvy16ToneMap_AVX2<L>;
+#endif
+    return &Uyvy16ToneMap_Scalar<L>;
+}
+
+ToneMapFn
+GetUyvy16ToneMap(Isa isa, Layout layout)
+{
+    switch(layout) {
+        case LAYOUT_RGBA: return SelectUyvy16ToneMap<PackedRgba>(isa);
+        case LAYOUT_BGRA: return SelectUyvy16ToneMap<PackedBgra>(isa);
+        default:          return SelectUyvy16ToneMap<PackedRgb>(isa);
+    }
+}
+
+static inline int
+Round(double value)
+{
+    return (int)floor(value + 0.5);
+}
+
+// SMPTE ST 2084 signal (0 - 1) to nits and back
+static const double PQ_M1 = 2610.0 / 16384.0;
+static const double PQ_M2 = 2523.0 / 4096.0 * 128.0;
+static const double PQ_C1 = 3424.0 / 4096.0;
+static const double PQ_C2 = 2413.0 / 4096.0 * 32.0;
+static const double PQ_C3 = 2392.0 / 4096.0 * 32.0;
+
+static double
+PqToNits(double signal)
+{
+    double p   = pow(signal, 1.0 / PQ_M2);
+    double num = p - PQ_C1;
+    return 10000.0 * pow((num > 0.0 ? num : 0.0) / (PQ_C2 - PQ_C3 * p), 1.0 / PQ_M1);
+}
+
+static double
+NitsToPq(double nits)
+{
+    double y = pow(nits / 10000.0, PQ_M1);
+    return pow((PQ_C1 + PQ_C2 * y) / (1.0 + PQ_C3 * y), PQ_M2);
+}
+
+// ARIB STD-B67 signal (0 - 1) to relative scene light (0 - 1)
+static double
+HlgToScene(double signal)
+{
+    const double a = 0.17883277, b = 0.28466892, c = 0.55991073;
+    if(signal <= 0.5)
+        return signal * signal / 3.0;
+    return (exp((signal - c) / a) + b) / 12.0;
+}
+
+// display light in nits to linear SDR, 1 being SDR white
+static double
+ToneCurveNits(const ToneMapping &m, double peak, double white, double nits)
+{
+    double x = nits / white;
+
+    switch(m.curve) {
+        case TONE_REINHARD:
+        {
+            double w = peak / white;
+            x = x * (1.0 + x / (w * w)) / (1.0 + x);
+            break;
+        }
+        case TONE_BT2390:
+        {
+            // normalized to the source's PQ range, the knee starts at KS
+            // and the Hermite spline runs from there to SDR white
+            double src     = NitsToPq(peak);
+            double e       = NitsToPq(nits) / src;
+            double max_lum = NitsToPq(white) / src;
+            double ks      = 1.5 * max_lum - 0.5;
+
+            if(e > 1.0)  e  = 1.0;
+            if(ks < 0.0) ks = 0.0;
+            if(e > ks) {
+                double t  = (e - ks) / (1.0 - ks);
+                double t2 = t * t, t3 = t2 * t;
+                e = (2.0*t3 - 3.0*t2 + 1.0) * ks + (t3 - 2.0*t2 + t) * (1.0 - ks) + (-2.0*t3 + 3.0*t2) * max_lum;
+            }
+            x = PqToNits(e * src) / white;
+            break;
+        }
+        default:
+            break;
+    }
+
+    if(x > 1.0) return 1.0;
+    if(x < 0.0) return 0.0;
+    return x;
+}
+
+void
+CreateToneMapTables(ToneMapTables &t, const ToneMapping &mapping, const Colorimetry &colorimetry)
+{
+    // BT.2020 non-constant luminance, folded with the input range the same
+    // way as Coefficients10. Codes come out on the 0 - 1020 scale.
+    const double kr = 0.2627, kb = 0.0593, kg = 1.0 - kr - kb;
+    bool   limited  = (colorimetry.inputRange == RANGE_LIMITED);
+    double ys       = limited ? 255.0 / 219.0 : 1.0;
+    double cs       = limited ? 255.0 / 224.0 : 1.0;
+
+    t.mapping     = mapping;
+    t.colorimetry = colorimetry;
+    t.yk          = Round(8192.0 * ys);
+    t.rv          = Round(8192.0 * cs * 2.0 * (1.0 - kr));
+    t.gu          = Round(8192.0 * cs * 2.0 * kb * (1.0 - kb) / kg);
+    t.gv          = Round(8192.0 * cs * 2.0 * kr * (1.0 - kr) / kg);
+    t.bu          = Round(8192.0 * cs * 2.0 * (1.0 - kb));
+    t.bias        = -(limited ? 64 : 0) * t.yk + 4096;
+
+    // BT.2087
+    const double gamut[9] = {  1.6605, -0.5876, -0.0728,
+                              -0.1246,  1.1329, -0.0083,
+                              -0.0182, -0.1006,  1.1187 };
+    for(int k=0; k<9; k++)
+        t.gamut[k] = Round(4096.0 * gamut[k]);
+
+    double white = mapping.sdrWhite > 0.0f ? mapping.sdrWhite : 203.0;
+    double peak  = mapping.sourcePeak > white ? mapping.sourcePeak : white;
+    double gamma = 1.2 + 0.42 * log10(peak / 1000.0);   // BT.2100 HLG system gamma
+
+    for(int code=0; code<TONE_EOTF_SIZE; code++) {
+        double signal = code < 1020 ? code / 1020.0 : 1.0;
+        double nits   = (mapping.transfer == TRANSFER_HLG) ? peak * pow(HlgToScene(signal), gamma)
+                                                           : PqToNits(signal);
+        t.eotf[code] = Round(65535.0 * ToneCurveNits(mapping, peak, white, nits));
+    }
+
+    bool   limited_out = (colorimetry.outputRange == RANGE_LIMITED);
+    for(int i=0; i<TONE_OETF_SIZE; i++) {
+        double l = i / (double)(TONE_OETF_SIZE - 1);
+        double v = (l < 0.018) ? 4.5 * l : 1.099 * pow(l, 0.45) - 0.099;
+        t.oetf[i] = (unsigned char)(limited_out ? Round(16.0 + 219.0 * v) : Round(255.0 * v));
+    }
+    t.oetf[TONE_OETF_SIZE] = t.oetf[TONE_OETF_SIZE + 1] = t.oetf[TONE_OETF_SIZE + 2] = 0;
+}
+
+static inline unsigned int
+CubeChannel(float value)
+{
+    if(!(value > 0.0f))  return 0;      // NaN too
+    if(value >= 1.0f)    return 1020;
+    return (unsigned int)(value * 1020.0f + 0.5f);
+}
+
+// Reads the Adobe / Resolve .cube format: keyword lines, then one "r g b"
+// line per entry with red changing fastest. Only 3D tables over the default
+// 0 - 1 domain are supported, output values get clamped to 0 - 1.
+bool
+ParseCube(std::istream &in, Lut3D &lut, std::string &error)
+{
+    std::vector<unsigned int> entries;
+    std::string               line;
+    int                       size = 0;
+
+    while(std::getline(in, line)) {
+        std::string::size_type comment = line.find('#');
+        if(comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string        key;
+        if(!(fields >> key))
+            continue;
+
+        char first = key[0];
+        if((first >= '0' && first <= '9') || first == '-' || first == '+' || first == '.') {
+            std::istringstream values(line);
+            float r, g, b;
+            if(!(values >> r >> g >> b)) {
+                error = "bad entry \"" + line + "\"";
+                return false;
+            }
+            if(size == 0) {
+                error = "entries before LUT_3D_SIZE";
+                return false;
+            }
+            entries.push_back(CubeChannel(r) | (CubeChannel(g) << 10) | (CubeChannel(b) << 20));
+        } else if(key == "LUT_3D_SIZE") {
+            if(!(fields >> size) || size < MIN_LUT3D_SIZE || size > MAX_LUT3D_SIZE) {
+                error = "LUT_3D_SIZE has to be 2 - 65";
+                return false;
+            }
+        } else if(key == "LUT_1D_SIZE") {
+            error = "1D LUTs aren't supported";
+            return false;
+        } else if(key == "DOMAIN_MIN" || key == "DOMAIN_MAX" || key == "LUT_3D_INPUT_RANGE") {
+            float expected = (key == "DOMAIN_MAX") ? 1.0f : 0.0f;
+            float value;
+            int   count = 0;
+            for(; fields >> value; count++) {
+                if(key == "LUT_3D_INPUT_RANGE")
+                    expected = (count == 0) ? 0.0f : 1.0f;
+                if(value != expected) {
+                    error = "only the 0 - 1 input domain is supported";
+                    return false;
+                }
+            }
+        }
+        // TITLE and anything application specific gets ignored
+    }
+
+    if(size == 0) {
+        error = "no LUT_3D_SIZE";
+        return false;
+    }
+    if(entries.size() != (size_t)(size * size * size)) {
+        std::ostringstream msg;
+        msg << "expected " << size * size * size << " entries, found " << entries.size();
+        error = msg.str();
+        return false;
+    }
+
+    lut.size = size;
+    lut.entries.swap(entries);
+    return true;
+}
+
+} // namespace DLConvert
@@ -0,0 +1,284 @@
+// Copyright (c) 2011, James Hughes
+// All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+
+// Platform independent pixel conversion kernels used by DLCapture.
+//
+// Nothing in here knows about the Decklink API, COM or openframeworks so the
+// kernels can be compiled (and measured) on any box with an x86 compiler.
+// Every kernel works on a run of pixels from a single row; DLCapture is
+// responsible for splitting frames up and handing the pieces to its workers.
+
+// x86 SIMD paths are only compiled where the intrinsics are available.
+// MSVC didn't ship AVX2 intrinsics until Visual Studio 2012.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+  #define DL_HAVE_SSSE3 1
+  #if !defined(_MSC_VER) || (_MSC_VER >= 1700)
+    #define DL_HAVE_AVX2 1
+  #endif
+#endif
+
+namespace DLConvert
+{
+    // instruction sets we have hand-written kernels for, in order of preference
+    enum Isa {
+        ISA_SCALAR,
+        ISA_SSSE3,
+        ISA_AVX2
+    };
+
+    // how YUV gets turned into RGB
+    enum Method {
+        METHOD_FIXED_POINT,     // integer math, vectorized where possible. Working set fits in L1
+        METHOD_LOOKUP_TABLE     // precomputed tables, ~16.5 MB that get hit at random
+    };
+
+    // YUV -> RGB matrix
+    enum Matrix {
+        MATRIX_BT601,           // SD
+        MATRIX_BT709            // HD and 2k
+    };
+
+    // quantization range of a signal
+    enum Range {
+        RANGE_FULL,             // 0 - 255
+        RANGE_LIMITED           // 16 - 235 luma, 16 - 240 chroma ("video levels")
+    };
+
+    // byte order of the pixels the YUV -> RGB kernels write
+    enum Layout {
+        LAYOUT_RGB,             // packed 24-bit
+        LAYOUT_RGBA,            // 32-bit, alpha set to 255
+        LAYOUT_BGRA             // 32-bit, alpha set to 255
+    };
+
+    // how the chroma of a 4:2:2 macropixel gets spread over its two pixels
+    enum ChromaUpsampling {
+        CHROMA_NEAREST,         // both pixels use it as is (fastest, fringes on sharp color edges)
+        CHROMA_LINEAR           // the odd pixel gets it averaged with the next macropixel's (~25% slower)
+    };
+
+    // everything the color math depends on. The default is what this addon
+    // has always done: BT.601 with the full range passed straight through.
+    struct Colorimetry {
+        Colorimetry() : matrix(MATRIX_BT601), inputRange(RANGE_FULL), outputRange(RANGE_FULL) {}
+        Colorimetry(Matrix m, Range in, Range out) : matrix(m), inputRange(in), outputRange(out) {}
+
+        bool operator==(const Colorimetry &other) const {
+            return matrix == other.matrix && inputRange == other.inputRange && outputRange == other.outputRange;
+        }
+        bool operator!=(const Colorimetry &other) const { return !(*this == other); }
+
+        Matrix          matrix;
+        Range           inputRange;     // range of the YUV coming off the card
+        Range           outputRange;    // range of the RGB we hand out
+    };
+
+    // what the float kernels write
+    enum FloatFormat {
+        FLOAT_32,
+        FLOAT_16                // IEEE half, stored as unsigned short
+    };
+
+    // applied to the 0 - 255 RGB values on their way to float:
+    //   out = (value - mean) * scale
+    // per channel, in R G B order. The default maps to 0 - 1.
+    struct Normalization {
+        Normalization() {
+            for(int c=0; c<3; c++) {
+                mean[c]  = 0.0f;
+                scale[c] = 1.0f / 255.0f;
+            }
+        }
+
+        float           mean[3];
+        float           scale[3];
+    };
+
+    // tables are done for all possible values 0 - 255 of yuv rather than just
+    // "legal" values of yuv. two dimensional arrays for red & blue, three
+    // dimensions for green
+    struct LookupTables {
+        unsigned char   red[256][256];          // [y][v]
+        unsigned char   blue[256][256];         // [y][u]
+        unsigned char   green[256][256][256];   // [y][u][v]
+        Colorimetry     colorimetry;            // what the tables were built for
+    };
+
+    // converts numPixels pixels from the start of src to the start of dst
+    typedef void (*RowFn)(const unsigned char *src, unsigned char *dst, long numPixels);
+
+    Isa             DetectIsa(void);                // best instruction set supported by this CPU and OS
+    unsigned short  FloatToHalf(float value);       // round to nearest even, like F16C
+    const char*     IsaName(Isa isa);
+    const char*     MethodName(Method method);
+
+    // The fixed point kernels are compiled separately for every matrix, range
+    // and output layout combination, so none of it gets decided per pixel.
+    // This hands back the right one for the given instruction set.
+    RowFn           GetUyvyToRgb(Isa isa, const Colorimetry &colorimetry, Layout layout = LAYOUT_RGB,
+                                 ChromaUpsampling chroma = CHROMA_NEAREST);
+
+    // UYVY -> float RGB in the same pass as the YUV decode. Planar kernels
+    // write R, G and B to dst[0], dst[1] and dst[2], interleaved kernels
+    // write RGB to dst[0].
+    typedef void (*FloatRowFn)(const unsigned char *uyvy, unsigned char *const dst[3], const Normalization &norm, long numPixels);
+
+    FloatRowFn      GetUyvyToFloat(Isa isa, const Colorimetry &colorimetry, FloatFormat format, bool planar);
+
+    void            CreateLookupTables(LookupTables &lut, const Colorimetry &colorimetry);
+    void            UyvyToRgb_Lut(const LookupTables &lut, const unsigned char *uyvy, unsigned char *rgb, long numPixels,
+                                  Layout layout = LAYOUT_RGB, ChromaUpsampling chroma = CHROMA_NEAREST);
+
+    RowFn           GetUyvyToGray(Isa isa);         // just the luma, chroma never gets touched
+    void            UyvyToUyvy16(const unsigned char *uyvy, unsigned char *uyvy16, long numPixels);
+    void            UyvyToGray16(const unsigned char *uyvy, unsigned char *gray16, long numPixels);
+
+    // 16-bit UYVY (as made by the v210 unpacker) -> 16-bit RGB, with the
+    // color math done at 10 bits. Samples end up in the top 10 bits.
+    RowFn           GetUyvy16ToRgb16(Isa isa, const Colorimetry &colorimetry);
+
+    // v210 is 10-bit 4:2:2 packed as three samples per little endian 32-bit
+    // word, 6 pixels per 16 bytes. The samples come in the same order as UYVY:
+    //
+    //   word 0: Cb0 Y0  Cr0     word 2: Cr1 Y3  Cb2
+    //   word 1: Y1  Cb1 Y2      word 3: Y4  Cr2 Y5
+    //
+    // (first sample in bits 0-9). Rows are padded to a multiple of 48 pixels.
+    RowFn           GetV210ToUyvy(Isa isa);         // rounded to 8-bit UYVY, to feed the 8-bit kernels
+    RowFn           GetV210ToUyvy16(Isa isa);       // 16-bit UYVY, samples shifted up to the top of the 16 bits
+    RowFn           GetV210ToGray(Isa isa);         // rounded to 8-bit luma
+    RowFn           GetV210ToGray16(Isa isa);       // 16-bit luma, samples shifted up to the top of the 16 bits
+
+    RowFn           GetArgbToBgra(Isa isa);         // byte swizzle, for cards that only deliver ARGB
+
+    // r210 (bmdFormat10BitRGB) is one big endian 32-bit word per pixel with
+    // 10-bit R, G and B in bits 20-29, 10-19 and 0-9. Rows are padded to a
+    // multiple of 64 pixels. The card sends SMPTE levels (64 - 940), so the
+    // colorimetry's ranges apply as they do to luma; the matrix doesn't.
+    RowFn           GetR210ToRgb(Isa isa, const Colorimetry &colorimetry, Layout layout = LAYOUT_RGB);
+    RowFn           GetR210ToRgb16(Isa isa);        // 16 bits per channel, samples shifted up to the top of the 16 bits
+
+    // 4:2:2 -> 4:2:0 works on two rows at a time: the luma of both rows is
+    // copied to y0 and y1 and their chroma is averaged into a single row of
+    // chroma. Planar (I420) kernels write Cb to u and Cr to v, semi-planar
+    // (NV12) kernels write interleaved Cb Cr to u and leave v alone.
+    typedef void (*RowPairFn)(const unsigned char *uyvy0, const unsigned char *uyvy1,
+                              unsigned char *y0, unsigned char *y1,
+                              unsigned char *u, unsigned char *v, long numPixels);
+
+    RowPairFn       GetUyvyToNv12(Isa isa);
+    RowPairFn       GetUyvyToI420(Isa isa);
+
+    // Box (area) downscaling in the 4:2:2 domain, so only the output pixels
+    // need color converting. The rows that make up a box are added into 16-bit
+    // sums first, then the GetUyvyBoxDownscale kernel averages them across each box.
+    // 16 bits hold at most MAX_BOX_ROWS rows of 8-bit samples.
+    enum { MAX_BOX_ROWS = 257 };
+
+    // where each output pixel's box starts and ends, worked out once per
+    // source and destination width rather than per sample
+    struct BoxColumns {
+        BoxColumns() : srcWidth(0), dstWidth(0), maxCount(0), ratio(0) {}
+
+        long                srcWidth;
+        long                dstWidth;
+        long                maxCount;   // widest box in source pixels or macropixels
+        long                ratio;      // 2 or 4 when every box is that many pixels wide, 0 otherwise
+        std::vector<long>   edges;      // luma of output pixel x is source pixels [edges[x], edges[x + 1])
+        std::vector<long>   chroma;     // first and last + 1 source macropixel of each output macropixel
+    };
+
+    typedef void (*AccumulateFn)(const unsigned char *src, unsigned short *sums, long numBytes);
+    typedef void (*BoxDownscaleFn)(const BoxColumns &columns, const unsigned short *sums, long numRows, unsigned char *uyvy);
+
+    AccumulateFn    GetAccumulateRow(Isa isa);     // sums[i] += src[i]
+    void            CreateBoxColumns(BoxColumns &columns, long srcWidth, long dstWidth);
+    BoxDownscaleFn  GetUyvyBoxDownscale(Isa isa);  // 2:1 and 4:1 are vectorized, other ratios aren't
+
+    // A 3D color lookup table (a grading LUT) applied to 8-bit RGB with
+    // tetrahedral interpolation. Entries are stored red fastest like .cube
+    // files, each channel in 8.2 fixed point (0 - 1020) with R, G and B packed
+    // into bits 0-9, 10-19 and 20-29 so one 32-bit load fetches a whole entry.
+    enum { MIN_LUT3D_SIZE = 2, MAX_LUT3D_SIZE = 65 };
+
+    struct Lut3D {
+        Lut3D() : size(0) {}
+
+        int                         size;       // points along each axis
+        std::vector<unsigned int>   entries;    // size * size * size
+    };
+
+    // grades numPixels pixels in place, alpha is left alone
+    typedef void (*Lut3DFn)(const Lut3D &lut, unsigned char *pixels, long numPixels);
+
+    bool            ParseCube(std::istream &in, Lut3D &lut, std::string &error);   // .cube text, false (and why) if it's no good
+    Lut3DFn         GetApplyLut3D(Isa isa, Layout layout);
+
+    // HDR -> SDR for 10-bit BT.2020 YUV carrying PQ (SMPTE ST 2084) or HLG
+    // (ARIB STD-B67). Each pixel goes through the BT.2020 matrix to R'G'B'
+    // codes, a table that decodes the transfer function and tone maps each
+    // channel to linear SDR, a BT.2020 -> BT.709 gamut matrix and a BT.709
+    // OETF table down to 8 bits. The two tables come to 8 KB, so they stay in
+    // L1 next to the row being converted.
+    enum Transfer {
+        TRANSFER_PQ,
+        TRANSFER_HLG            // the system gamma for sourcePeak is applied per channel
+    };
+
+    enum ToneCurve {
+        TONE_CLIP,              // linear up to SDR white, clipped above it
+        TONE_REINHARD,          // extended Reinhard with sourcePeak landing on SDR white
+        TONE_BT2390             // the BT.2390 EETF knee, rolled off in the PQ domain
+    };
+
+    struct ToneMapping {
+        ToneMapping() : transfer(TRANSFER_PQ), curve(TONE_BT2390), sourcePeak(1000.0f), sdrWhite(203.0f) {}
+
+        Transfer        transfer;
+        ToneCurve       curve;
+        float           sourcePeak;     // nits the source was graded to, or the HLG display peak
+        float           sdrWhite;       // nits that come out as 100% SDR (BT.2408 HDR reference white is 203)
+    };
+
+    enum { TONE_EOTF_SIZE = 1024, TONE_OETF_SIZE = 4096 };
+
+    struct ToneMapTables {
+        ToneMapping     mapping;
+        Colorimetry     colorimetry;                // only the ranges are used, the matrix is always BT.2020
+        int             yk, rv, gu, gv, bu, bias;   // YUV -> R'G'B' codes, scaled by 8192 as for GetUyvy16ToRgb16
+        int             gamut[9];                   // BT.2020 -> BT.709 in linear light, scaled by 4096
+        int             eotf[TONE_EOTF_SIZE];       // R'G'B' code -> tone mapped linear, 0 - 65535
+        unsigned char   oetf[TONE_OETF_SIZE + 3];   // linear >> 4 -> 8-bit BT.709, padded for 32-bit gathers
+    };
+
+    // 16-bit UYVY in (as made by the v210 unpacker), 8-bit RGB out
+    typedef void (*ToneMapFn)(const ToneMapTables &tables, const unsigned char *uyvy16, unsigned char *rgb, long numPixels);
+
+    void            CreateToneMapTables(ToneMapTables &tables, const ToneMapping &mapping, const Colorimetry &colorimetry);
+    ToneMapFn       GetUyvy16ToneMap(Isa isa, Layout layout);
+}
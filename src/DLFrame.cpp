@@ -24,30 +24,130 @@
 #include "DLFrame.h"
 #include "cxtypes.h" // opencv types for colorspaces
 
-DLFrame::~DLFrame(){ delete pixels; }
+// older GL headers don't have half floats
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+DLFrame::~DLFrame()
+{
+    // borrowed pixels go back to whoever owns them when _mOwner lets go
+    if(!_mOwner)
+        delete pixels;
+}
 
 DLFrame::DLFrame(long width, long height, long row_bytes, ColorSpace color_space)
 //DLFrame::DLFrame(long width, long height, long row_bytes, ColorSpace color_space, bool bUseTexture)
 {
-    this->pixels      = new BYTE[height*row_bytes];
+    this->pixels      = new BYTE[bufferBytes(color_space, height, row_bytes)];
     this->width       = width;
     this->height      = height;
+    this->sequence    = 0;
     _mRowBytes        = row_bytes;
     _mColorSpace      = color_space;
+    InitPlanes();
     //_mTex.loadData(getPixels(), (int)width, (int)height, getOpenGLType());
 }
 
+// hands VirtualAllocExNuma'd pixels back
+struct VirtualFreePixels
+{
+    void operator()(void* pixels) const { VirtualFree(pixels, 0, MEM_RELEASE); }
+};
+
+// Same as above, but the pixels come from numa_node's memory so the threads
+// pinned to that node don't have to reach across to another socket for
+// them. Falls back to the normal heap if the node can't supply them.
+DLFrame::DLFrame(long width, long height, long row_bytes, ColorSpace color_space, int numa_node)
+{
+    SIZE_T bytes = bufferBytes(color_space, height, row_bytes);
+    BYTE*  data  = NULL;
+
+    if(numa_node >= 0)
+        data = (BYTE*)VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, numa_node);
+
+    if(data) {
+        this->pixels  = data;
+        _mOwner       = boost::shared_ptr<void>(data, VirtualFreePixels());
+    } else {
+        this->pixels  = new BYTE[bytes];
+    }
+    this->width       = width;
+    this->height      = height;
+    this->sequence    = 0;
+    _mRowBytes        = row_bytes;
+    _mColorSpace      = color_space;
+    InitPlanes();
+}
+
 DLFrame::DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space)
 //DLFrame::DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space, bool bUseTexture)
 {
     this->pixels      = data;
     this->width       = width;
     this->height      = height;
+    this->sequence    = 0;
     _mRowBytes        = row_bytes;
     _mColorSpace      = color_space;
+    InitPlanes();
     //_mTex.loadData(getPixels(), (int)width, (int)height, getOpenGLType());
 }
 
+// wrap someone else's buffer without copying it. owner is released (and
+// whatever its deleter does happens) when this frame is destroyed.
+DLFrame::DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space, boost::shared_ptr<void> owner)
+{
+    this->pixels      = data;
+    this->width       = width;
+    this->height      = height;
+    this->sequence    = 0;
+    _mRowBytes        = row_bytes;
+    _mColorSpace      = color_space;
+    _mOwner           = owner;
+    InitPlanes();
+}
+
+// works out where each plane starts in pixels
+void
+DLFrame::InitPlanes()
+{
+    long chroma_height = (height + 1) / 2;
+
+    _mPlanes[0]        = pixels;
+    _mPlaneRowBytes[0] = _mRowBytes;
+    _mPlaneHeight[0]   = height;
+
+    switch( _mColorSpace ) {
+        case DL_NV12:
+            _mPlaneCount       = 2;
+            _mPlanes[1]        = _mPlanes[0] + _mRowBytes * height;
+            _mPlaneRowBytes[1] = ((_mRowBytes + 1) / 2) * 2;
+            _mPlaneHeight[1]   = chroma_height;
+            break;
+        case DL_I420:
+            _mPlaneCount       = 3;
+            _mPlanes[1]        = _mPlanes[0] + _mRowBytes * height;
+            _mPlaneRowBytes[1] = (_mRowBytes + 1) / 2;
+            _mPlaneHeight[1]   = chroma_height;
+            _mPlanes[2]        = _mPlanes[1] + _mPlaneRowBytes[1] * chroma_height;
+            _mPlaneRowBytes[2] = _mPlaneRowBytes[1];
+            _mPlaneHeight[2]   = chroma_height;
+            break;
+        case DL_RGB32F_PLANAR:
+        case DL_RGB16F_PLANAR:
+            _mPlaneCount       = 3;
+            for(int plane=1; plane<3; plane++) {
+                _mPlanes[plane]        = _mPlanes[plane-1] + _mRowBytes * height;
+                _mPlaneRowBytes[plane] = _mRowBytes;
+                _mPlaneHeight[plane]   = height;
+            }
+            break;
+        default:
+            _mPlaneCount       = 1;
+            break;
+    }
+}
+
 long
 DLFrame::getWidth()
 {
@@ -60,6 +160,12 @@ DLFrame::getHeight()
     return height;
 }
 
+long
+DLFrame::getRowBytes()
+{
+    return _mRowBytes;
+}
+
 unsigned char*
 DLFrame::getPixels()
 {
@@ -72,6 +178,30 @@ DLFrame::getNativeType()
     return _mColorSpace;
 }
 
+int
+DLFrame::getPlaneCount()
+{
+    return _mPlaneCount;
+}
+
+BYTE*
+DLFrame::getPlane(int plane)
+{
+    return (plane < _mPlaneCount) ? _mPlanes[plane] : NULL;
+}
+
+long
+DLFrame::getPlaneRowBytes(int plane)
+{
+    return (plane < _mPlaneCount) ? _mPlaneRowBytes[plane] : 0;
+}
+
+long
+DLFrame::getPlaneHeight(int plane)
+{
+    return (plane < _mPlaneCount) ? _mPlaneHeight[plane] : 0;
+}
+
 int
 DLFrame::getOpenGLType()
 {
@@ -80,6 +210,52 @@ DLFrame::getOpenGLType()
             return GL_LUMINANCE;
         case DL_RGB:
             return GL_RGB;
+        case DL_YUV16:
+            return GL_LUMINANCE_ALPHA;
+        case DL_BGRA:
+            return GL_BGRA;
+        case DL_RGBA:
+            return GL_RGBA;
+        case DL_NV12:
+        case DL_I420:
+            return GL_LUMINANCE;    // just the luma plane
+        case DL_RGB32F:
+        case DL_RGB16F:
+        case DL_RGB16:
+            return GL_RGB;
+        case DL_RGB32F_PLANAR:
+        case DL_RGB16F_PLANAR:
+            return GL_LUMINANCE;    // just the red plane
+        case DL_GRAY16:
+            return GL_LUMINANCE;
+    }
+
+    // shouldn't get here
+    std::cout << "DLFrame - _mColorSpace is set to something illegal" << std::endl;
+	throw;
+}
+
+int
+DLFrame::getOpenGLDataType()
+{
+    switch( _mColorSpace ) {
+        case DL_GRAYSCALE:
+        case DL_RGB:
+        case DL_BGRA:
+        case DL_RGBA:
+        case DL_NV12:
+        case DL_I420:
+            return GL_UNSIGNED_BYTE;
+        case DL_YUV16:
+        case DL_RGB16:
+        case DL_GRAY16:
+            return GL_UNSIGNED_SHORT;
+        case DL_RGB32F:
+        case DL_RGB32F_PLANAR:
+            return GL_FLOAT;
+        case DL_RGB16F:
+        case DL_RGB16F_PLANAR:
+            return GL_HALF_FLOAT;
     }
 
     // shouldn't get here
@@ -95,6 +271,60 @@ DLFrame::getOpenCVType()
             return CV_8UC1;
         case DL_RGB:
             return CV_8UC3;
+        case DL_YUV16:
+            return CV_16UC2;
+        case DL_BGRA:
+        case DL_RGBA:
+            return CV_8UC4;
+        case DL_NV12:
+        case DL_I420:
+            return CV_8UC1;         // just the luma plane
+        case DL_RGB32F:
+            return CV_32FC3;
+        case DL_RGB32F_PLANAR:
+            return CV_32FC1;        // just the red plane
+        // OpenCV has no half floats, these are the raw bits
+        case DL_RGB16F:
+            return CV_16UC3;
+        case DL_RGB16F_PLANAR:
+            return CV_16UC1;
+        case DL_RGB16:
+            return CV_16UC3;
+        case DL_GRAY16:
+            return CV_16UC1;
+    }
+
+    // shouldn't get here
+    std::cout << "DLFrame - colorSpace is set to something illegal" << std::endl;
+    throw;
+}
+
+long
+DLFrame::packedRowBytes(ColorSpace color_space, long width)
+{
+    switch( color_space ) {
+        case DL_GRAYSCALE:
+            return width;
+        case DL_RGB:
+            return width * 3;
+        case DL_YUV16:
+            return ((width + 1) / 2) * 8;   // whole macropixels
+        case DL_BGRA:
+        case DL_RGBA:
+            return width * 4;
+        case DL_NV12:
+        case DL_I420:
+            return width;
+        case DL_RGB32F:
+            return width * 12;
+        case DL_RGB16F:
+        case DL_RGB16:
+            return width * 6;
+        case DL_RGB32F_PLANAR:
+            return width * 4;
+        case DL_RGB16F_PLANAR:
+        case DL_GRAY16:
+            return width * 2;
     }
 
     // shouldn't get here
@@ -102,6 +332,24 @@ DLFrame::getOpenCVType()
     throw;
 }
 
+long
+DLFrame::bufferBytes(ColorSpace color_space, long height, long row_bytes)
+{
+    long chroma_height = (height + 1) / 2;
+
+    switch( color_space ) {
+        case DL_NV12:
+        case DL_I420:
+            // either one Cb Cr plane or two half width planes, same size
+            return row_bytes * height + ((row_bytes + 1) / 2) * 2 * chroma_height;
+        case DL_RGB32F_PLANAR:
+        case DL_RGB16F_PLANAR:
+            return row_bytes * height * 3;
+        default:
+            return row_bytes * height;
+    }
+}
+
 // void
 // DLFrame::setUseTexture(bool bUse)
 // {
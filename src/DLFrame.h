@@ -22,6 +22,7 @@
 #pragma once;
 
 #include "windows.h"
+#include "boost/shared_ptr.hpp"
 #include "cxtypes.h" // opencv types for colorspaces
 #include "ofTexture.h"
 
@@ -30,12 +31,30 @@ class DLFrame
 public:
     enum ColorSpace {
         DL_GRAYSCALE,  // grayscale
-        DL_RGB         // RGB color
+        DL_RGB,        // RGB color
+        DL_YUV16,      // UYVY 4:2:2, 16 bits per sample (10-bit samples in the top bits)
+        DL_BGRA,       // 32-bit BGRA color
+        DL_RGBA,       // 32-bit RGBA color
+        DL_NV12,       // YUV 4:2:0, Y plane followed by an interleaved Cb Cr plane
+        DL_I420,       // YUV 4:2:0, Y plane followed by Cb and Cr planes
+        DL_RGB32F,     // float RGB
+        DL_RGB16F,     // half float RGB
+        DL_RGB32F_PLANAR, // float R, G and B planes
+        DL_RGB16F_PLANAR, // half float R, G and B planes
+        DL_RGB16,      // RGB, 16 bits per channel (10-bit samples in the top bits)
+        DL_GRAY16      // grayscale, 16 bits per sample (10-bit samples in the top bits)
     };
 
-    DLFrame(){};
+    // planar frames keep every plane in the one buffer, one after the other.
+    // row_bytes is the stride of the first plane. 4:2:0 chroma planes are
+    // half the height (and width) of it, RGB planes are all the same size.
+    enum { MAX_PLANES = 3 };
+
+    DLFrame() : sequence(0) {};
     DLFrame(long width, long height, long row_bytes, ColorSpace color_space);
+    DLFrame(long width, long height, long row_bytes, ColorSpace color_space, int numa_node); // pixels on a NUMA node, -1 for anywhere
     DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space);
+    DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space, boost::shared_ptr<void> owner);
     // DLFrame(long width, long height, long row_bytes, ColorSpace color_space, bool bUseTexture = false);
     // DLFrame(BYTE* data, long width, long height, long row_bytes, ColorSpace color_space, bool bUseTexture = false);
 
@@ -46,8 +65,17 @@ public:
     long            getRowBytes();
     BYTE*           getPixels();
 	int             getOpenGLType();
+	int             getOpenGLDataType();
 	int             getOpenCVType();
     ColorSpace      getNativeType();
+
+    int             getPlaneCount();                // 1 for everything but the 4:2:0 and planar RGB formats
+    BYTE*           getPlane(int plane);
+    long            getPlaneRowBytes(int plane);
+    long            getPlaneHeight(int plane);
+
+    static long     packedRowBytes(ColorSpace color_space, long width);  // row bytes with no padding (of the first plane)
+    static long     bufferBytes(ColorSpace color_space, long height, long row_bytes); // size of all planes together
     // void            setUseTexture(bool bUse);
     // void            draw(float x, float y, float w, float h);
     // void            draw(float x, float y);
@@ -58,10 +86,18 @@ public:
     BYTE*           pixels;
     long            width;
     long            height;
+    long            sequence;       // capture order, set by DLCapture. Gaps are dropped frames
 
 private:
     ColorSpace      _mColorSpace;
     long            _mRowBytes;
+    boost::shared_ptr<void> _mOwner;    // keeps borrowed pixels alive, NULL when we own them
+    int             _mPlaneCount;
+    BYTE*           _mPlanes[MAX_PLANES];
+    long            _mPlaneRowBytes[MAX_PLANES];
+    long            _mPlaneHeight[MAX_PLANES];
+
+    void            InitPlanes();
     // bool            _mUseTexture;
     // ofTexture       _mTex;
 
@@ -32,6 +32,23 @@
 #define COLUMN_WIDTH 35
 using namespace std;
 
+// Texture format for frames uploaded as glType. 4-byte pixels get a 4
+// channel texture so the driver can copy them straight in rather than
+// repacking them to RGB on every upload.
+static int
+TextureFormat(int glType)
+{
+    switch(glType) {
+        case GL_LUMINANCE:
+            return GL_LUMINANCE;
+        case GL_RGBA:
+        case GL_BGRA:
+            return GL_RGBA;
+        default:
+            return GL_RGB;
+    }
+}
+
 ofxBlackmagic::ofxBlackmagic()
 {
 	IDeckLinkIterator*			deckLinkIterator;
@@ -93,6 +110,7 @@ ofxBlackmagic::ofxBlackmagic()
     setVerbose(false);
     _mNewFrame   = false;
 	_mUseTexture = true;
+	_mTexFormat  = 0;
 }
 
 ofxBlackmagic::~ofxBlackmagic()
@@ -142,6 +160,77 @@ bool ofxBlackmagic::setPixelFormat(BMDPixelFormat pixelFormat)
     return _mActiveCard->setPixelFormat(pixelFormat);
 }
 
+void ofxBlackmagic::setConversionMethod(DLConvert::Method method)
+{
+    _mActiveCard->m_pDelegate->setConversionMethod(method);
+}
+
+void ofxBlackmagic::setColorimetry(const DLConvert::Colorimetry &colorimetry)
+{
+    _mActiveCard->setColorimetry(colorimetry);
+}
+
+bool ofxBlackmagic::setColorspace(DLFrame::ColorSpace colorspace)
+{
+    if(!_mActiveCard->m_pDelegate->setColorspace(colorspace))
+        return false;
+
+    // match the texture to the new frames
+    if(_mUseTexture)
+        setUseTexture(true);
+    return true;
+}
+
+void ofxBlackmagic::setPipelineDepth(int depth)
+{
+    _mActiveCard->m_pDelegate->setPipelineDepth(max(depth, 1));
+}
+
+void ofxBlackmagic::setFramesInFlight(int frames)
+{
+    _mActiveCard->m_pDelegate->setFramesInFlight(max(frames, 1));
+}
+
+void ofxBlackmagic::setCpuAffinity(DWORD_PTR mask)
+{
+    _mActiveCard->m_pDelegate->setCpuAffinity(mask);
+}
+
+bool ofxBlackmagic::setNumaNode(int node)
+{
+    return _mActiveCard->m_pDelegate->setNumaNode(node);
+}
+
+void ofxBlackmagic::setChromaUpsampling(DLConvert::ChromaUpsampling chroma)
+{
+    _mActiveCard->m_pDelegate->setChromaUpsampling(chroma);
+}
+
+void ofxBlackmagic::setNormalization(const DLConvert::Normalization &normalization)
+{
+    _mActiveCard->m_pDelegate->setNormalization(normalization);
+}
+
+bool ofxBlackmagic::loadLut3D(const std::string &path)
+{
+    return _mActiveCard->m_pDelegate->loadLut3D(path);
+}
+
+void ofxBlackmagic::clearLut3D()
+{
+    _mActiveCard->m_pDelegate->clearLut3D();
+}
+
+void ofxBlackmagic::setToneMapping(const DLConvert::ToneMapping &mapping)
+{
+    _mActiveCard->m_pDelegate->setToneMapping(mapping);
+}
+
+void ofxBlackmagic::clearToneMapping()
+{
+    _mActiveCard->m_pDelegate->clearToneMapping();
+}
+
 void ofxBlackmagic::initGrabber(bool bTexture)
 {
 	_mActiveCard->initGrabber();
@@ -161,35 +250,79 @@ void ofxBlackmagic::grabFrame()
 {
     // we don't have ANYTHING to send to the client
     if(_mRawFrameInitialized == false){
-        // idle until we have SOMETHING
-        while(_mActiveCard->m_pDelegate->getFrame(_mRawFrame))
-            Sleep(10);
+        // idle until we have SOMETHING, unless the card isn't going to
+        // send anything
+        while(!waitForFrame(100)) {
+            if(!_mActiveCard->running())
+                return;
+        }
         // from now on we can send stale stuff
-        _mRawFrameInitialized = true;
 	} else if(_mActiveCard->m_pDelegate->getFrame(_mRawFrame)){
-		// TODO: test with with texture data loading in the background
-		_mTex.loadData(_mRawFrame->getPixels(), _mRawFrame->getWidth(), _mRawFrame->getHeight(), _mRawFrame->getOpenGLType());
-		_mNewFrame = true;
+		newFrame();
 	} else {
 		_mNewFrame = false;
 	}
 }
 
+// Waits for the next frame instead of polling, returns as soon as one's
+// converted. false (and isFrameNew() false) if nothing came in time.
+bool ofxBlackmagic::waitForFrame(int timeoutMs)
+{
+    if(_mActiveCard->m_pDelegate->waitForFrame(_mRawFrame, max(timeoutMs, 0)))
+        newFrame();
+    else
+        _mNewFrame = false;
+    return _mNewFrame;
+}
+
+void ofxBlackmagic::newFrame()
+{
+    // TODO: test with with texture data loading in the background
+    // ofTexture only uploads 8-bit data, deep frames are pixels-only
+    if(_mUseTexture && _mRawFrame->getOpenGLDataType() == GL_UNSIGNED_BYTE) {
+        int width  = (int)_mRawFrame->getWidth();
+        int height = (int)_mRawFrame->getHeight();
+        int type   = _mRawFrame->getOpenGLType();
+
+        // RGB input always comes out BGRA whatever the colorspace says, and
+        // the layout can change between setColorspace() and the next frame
+        if(TextureFormat(type) != _mTexFormat || width != (int)_mTex.getWidth() || height != (int)_mTex.getHeight())
+            allocateTexture(width, height, TextureFormat(type));
+        _mTex.loadData(_mRawFrame->getPixels(), width, height, type);
+    }
+    _mRawFrameInitialized = true;
+    _mNewFrame = true;
+}
+
+// the frame getPixels() hands out, once there is one
 float ofxBlackmagic::getWidth()
 {
+	if(_mRawFrameInitialized)
+		return (float)_mRawFrame->getWidth();
 	// TODO: make the delegate properties private
 	return (float)_mActiveCard->m_pDelegate->getWidth();
 }
 
 float ofxBlackmagic::getHeight()
 {
+	if(_mRawFrameInitialized)
+		return (float)_mRawFrame->getHeight();
 	// TODO: make the delegate properties private
 	return (float)_mActiveCard->m_pDelegate->getHeight();
 }
 
-void ofxBlackmagic::setSize(int new_width, int new_height)
+bool ofxBlackmagic::setSize(int new_width, int new_height)
 {
-    _mActiveCard->m_pDelegate->setSize(new_width, new_height);
+    return _mActiveCard->m_pDelegate->setSize(new_width, new_height);
+}
+
+void ofxBlackmagic::setCrop(int x, int y, int width, int height)
+{
+    _mActiveCard->m_pDelegate->setCrop(x, y, width, height);
+
+    // the frames change size with the crop
+    if(_mUseTexture)
+        setUseTexture(true);
 }
 
 unsigned char* ofxBlackmagic::getPixels()
@@ -204,6 +337,11 @@ int ofxBlackmagic::getFrameCount()
     return _mActiveCard->m_pDelegate->getFrameCount();
 }
 
+int ofxBlackmagic::getDroppedFrameCount()
+{
+    return _mActiveCard->m_pDelegate->getDroppedFrameCount();
+}
+
 float ofxBlackmagic::getFrameRate() 
 {
     return _mActiveCard->m_pDelegate->getFrameRate();
@@ -220,10 +358,31 @@ void ofxBlackmagic::setUseTexture(bool bUse)
 	if(bUse == true) {
 		int width = (int)_mActiveCard->m_pDelegate->getWidth();
 		int height = (int)_mActiveCard->m_pDelegate->getHeight();
-		_mTex.allocate(width, height,GL_RGB);
+		// luma only frames get a single channel texture, a third of the upload
+		switch(_mActiveCard->m_pDelegate->getColorspace()) {
+			case DLFrame::DL_GRAYSCALE:
+			case DLFrame::DL_GRAY16:
+			case DLFrame::DL_NV12:
+			case DLFrame::DL_I420:
+				allocateTexture(width, height, GL_LUMINANCE);
+				break;
+			case DLFrame::DL_RGBA:
+			case DLFrame::DL_BGRA:
+				allocateTexture(width, height, GL_RGBA);
+				break;
+			default:
+				allocateTexture(width, height, GL_RGB);
+				break;
+		}
 	}
 }
 
+void ofxBlackmagic::allocateTexture(int width, int height, int format)
+{
+    _mTex.allocate(width, height, format);
+    _mTexFormat = format;
+}
+
 void ofxBlackmagic::setAnchorPercent(float xPct, float yPct)
 {
     if (_mUseTexture)_mTex.setAnchorPercent(xPct, yPct);
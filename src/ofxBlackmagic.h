@@ -21,9 +21,12 @@
 
 #pragma once
 #include <objbase.h>        // Necessary for COM
+#include <string>
 #include <vector>
 #include "boost/shared_ptr.hpp"
 #include "DeckLinkAPI_h.h"
+#include "DLConvert.h"
+#include "DLFrame.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Valid parameters to setDisplayMode
@@ -70,11 +73,13 @@ public:
     void            draw(float x, float y, float w, float h);    // draw the pic to screen
     void            draw(float x, float y);                    
     int             getFrameCount();                             // get the # of captured frames
+    int             getDroppedFrameCount();                      // get the # of frames dropped because conversion fell behind
 	float           getFrameRate();                              // calculate the capture frame rate
     float           getHeight();                                 // get the height of the processed image
     float           getWidth();                                  // get the width of the processed image
     unsigned char*  getPixels();                                 // get a pointer to the image data
     void            grabFrame();                                 // pull the next captured frame
+    bool            waitForFrame(int timeoutMs);                 // pull the next captured frame, waiting up to timeoutMs for it
     void            initGrabber(bool bTexture = true);           // start image capture
     bool            isFrameNew();                                // is this a new image, or just the last one captured?
     void            listDevices();                               // dump some device data
@@ -84,11 +89,28 @@ public:
     void            setDeviceID(int _deviceID);                  // pick which decklink device to capture from
     bool            setDisplayMode(BMDDisplayMode displayMode);  // pick the hardware display mode (see table above)
     bool            setPixelFormat(BMDPixelFormat pixelFormat);  // pick the hardware pixel format (not all cards can change this)
-    void            setSize(int height, int width);              // software image resize
+    void            setPipelineDepth(int depth);                 // # of captured frames that can wait for conversion (2 by default)
+    void            setFramesInFlight(int frames);               // # of frames converted at once (2 by default), still handed out in order
+    void            setCpuAffinity(DWORD_PTR mask);              // CPUs this card's conversion threads run on, 0 for any
+    bool            setNumaNode(int node);                       // keep this card's conversion threads and frames on a NUMA node, -1 for any
+    void            setConversionMethod(DLConvert::Method method); // fixed point (default) or lookup table YUV conversion
+    void            setColorimetry(const DLConvert::Colorimetry &colorimetry); // override the YUV matrix/ranges picked from the display mode
+    void            setChromaUpsampling(DLConvert::ChromaUpsampling chroma); // nearest (default) or linear chroma for the RGB colorspaces, linear costs ~25%
+    bool            setColorspace(DLFrame::ColorSpace colorspace); // pick the output frame type (RGB by default, RGBA/BGRA for 4-byte pixels)
+    void            setNormalization(const DLConvert::Normalization &normalization); // per channel mean/scale for the float colorspaces
+    bool            loadLut3D(const std::string &path);          // grade the RGB frames with a .cube 3D LUT
+    void            clearLut3D();                                // stop grading
+    void            setToneMapping(const DLConvert::ToneMapping &mapping); // PQ/HLG 10-bit YUV to SDR BT.709 RGB
+    void            clearToneMapping();                          // back to treating the input as SDR
+    bool            setSize(int height, int width);              // software image resize, 0x0 for the capture/crop size, false for 16-bit YUV
+    void            setCrop(int x, int y, int width, int height); // only convert part of the frame (scaled to setSize() if given), 0 size to undo
     void            setVerbose(bool bTalkToMe = true);           // print a bunch of junk out
     void            setUseTexture(bool bUse);                    // load the captured frame to a texture
 
 private:
+    void                       newFrame();                       // upload _mRawFrame and flag it as new
+    void                       allocateTexture(int width, int height, int format);
+
     bool                       _mVerbose;
     std::vector<DLCard>        _mCards;
     DLCard*                    _mActiveCard;
@@ -97,4 +119,5 @@ private:
     bool                       _mNewFrame;
     bool                       _mUseTexture;
     ofTexture                  _mTex;
+    int                        _mTexFormat;                      // internal format _mTex was allocated with
 };